@@ -0,0 +1,73 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "grammar/grammar_analyzer.h"
+
+static const size_t MODULES = 16;
+
+/**
+ * Generates a grammar of 16 independent chains: r_m_i : 't_m_i' | r_m_(i+1) 'x',
+ * so the number of terminals grows with the number of rules. With cycles the last rule of a chain
+ * refers to the first one ('(' r_m_0 ')'), and the whole chain is a single strongly connected component.
+ */
+static std::vector<rule_cfg> generate(size_t rules, bool cycles) {
+  using symbols = std::vector<std::pair<RULE_TYPE, std::string>>;
+  size_t length = std::max<size_t>(1, rules / MODULES);
+  auto name = [](size_t module, size_t i) {
+    return "r_" + std::to_string(module) + "_" + std::to_string(i);
+  };
+  std::vector<rule_cfg> cfg;
+  for (size_t module = 0; module < MODULES; module++) {
+    cfg.emplace_back("s", symbols{{RULE_TYPE::TEXT, "m" + std::to_string(module)},
+                                  {RULE_TYPE::TRANSITION, name(module, 0)}});
+    for (size_t i = 0; i < length; i++) {
+      cfg.emplace_back(name(module, i), symbols{{RULE_TYPE::TEXT, "t" + std::to_string(module) + "_" + std::to_string(i)}});
+      if (i + 1 < length) {
+        cfg.emplace_back(name(module, i), symbols{{RULE_TYPE::TRANSITION, name(module, i + 1)}, {RULE_TYPE::TEXT, "x"}});
+      } else if (cycles) {
+        cfg.emplace_back(name(module, i), symbols{{RULE_TYPE::TEXT, "("}, {RULE_TYPE::TRANSITION, name(module, 0)},
+                                                  {RULE_TYPE::TEXT, ")"}});
+      }
+    }
+  }
+  return cfg;
+}
+
+/**
+ * Analyzes the generated grammar by one thread and by the given number of threads (all hardware threads by default),
+ * prints the best of 3 runs of each.
+ */
+int main(int argc, char **argv) {
+  std::string shape = argc > 2 ? argv[1] : "";
+  if (shape != "chains" && shape != "cycles") {
+    fprintf(stderr, "Usage: %s chains|cycles rules [threads]\n", argv[0]);
+    return 2;
+  }
+  size_t rules = std::stoul(argv[2]);
+  size_t threads = argc > 3 ? std::stoul(argv[3]) : std::max<size_t>(1, std::thread::hardware_concurrency());
+  std::vector<rule_cfg> cfg = generate(rules, shape == "cycles");
+
+  std::vector<size_t> runs{1};
+  if (threads > 1) {
+    runs.push_back(threads);
+  }
+  printf("%s, %zu rules:", shape.c_str(), rules);
+  for (size_t run_threads: runs) {
+    double best = 0;
+    for (int run = 0; run < 3; run++) {
+      auto start = std::chrono::steady_clock::now();
+      grammar_analyzer analyzer(cfg, "s", run_threads);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      best = run == 0 ? seconds : std::min(best, seconds);
+    }
+    printf(" %zu thread(s) %.3f s", run_threads, best);
+  }
+  printf("\n");
+}
@@ -0,0 +1,12 @@
+# Compares FIRST/FOLLOW analysis of large generated grammars by one thread and by all hardware threads.
+# Run from the repository root
+dir=$(dirname "$0")
+out=${TMPDIR:-/tmp}/analyzer_bench
+mkdir -p "$out" || exit
+g++ -std=c++17 -O2 -pthread -I. "$dir/analyzer_bench.cpp" grammar/grammar_analyzer.cpp parser/rule_cfg.cpp \
+  utils/task_graph.cpp -o "$out/analyzer_bench" || exit
+for shape in chains cycles; do
+  for rules in 8192 32768; do
+    "$out/analyzer_bench" "$shape" "$rules" || exit
+  done
+done
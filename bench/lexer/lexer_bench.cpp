@@ -0,0 +1,59 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include "gen.h"
+
+/**
+ * Lexes 64 MiB of random tokens by lexer::match and prints the best of 5 runs.
+ * digits input is for calc.txt (numbers joined by '+'), identifiers input is for list.txt ("let <identifier>,   ").
+ */
+int main(int argc, char **argv) {
+  std::string kind = argc > 1 ? argv[1] : "";
+  if (kind != "digits" && kind != "identifiers") {
+    fprintf(stderr, "Usage: %s digits|identifiers\n", argv[0]);
+    return 2;
+  }
+  std::string input;
+  std::mt19937 rnd(1);
+  while (input.size() < (64u << 20)) {
+    size_t len = 4 + rnd() % 28;
+    if (kind == "digits") {
+      for (size_t i = 0; i < len; i++) {
+        input += static_cast<char>('0' + rnd() % 10);
+      }
+      input += '+';
+    } else {
+      input += "let ";
+      input += "abcdefghijklmnopqrstuvwxyz_"[rnd() % 27];
+      for (size_t i = 1; i < len; i++) {
+        input += "abcdefghijklmnopqrstuvwxyz_0123456789"[rnd() % 37];
+      }
+      input += ",   ";
+    }
+  }
+
+  double best = 0;
+  for (int run = 0; run < 5; run++) {
+    auto start = std::chrono::steady_clock::now();
+    const char *it = input.data(), *end = it + input.size();
+    while (it != end) {
+      TOKEN_TYPE type;
+      bool at_end = false;
+      size_t len = lexer::match(it, end, type, at_end);
+      if (len == 0) {
+        fprintf(stderr, "Unexpected token at %zu\n", static_cast<size_t>(it - input.data()));
+        return 1;
+      }
+      it += len;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = run == 0 ? seconds : std::min(best, seconds);
+  }
+  printf("%s: %.0f MB/s\n", kind.c_str(), input.size() / best / 1e6);
+}
@@ -0,0 +1,19 @@
+# Compares lexing speed of the SIMD run kernels with the plain DFA walk (PARSER_NO_SIMD).
+# Run from the repository root after build.sh
+dir=$(dirname "$0")
+out=${TMPDIR:-/tmp}/lexer_bench
+for bench in calc:digits list:identifiers; do
+  grammar=${bench%%:*}
+  input=${bench#*:}
+  mkdir -p "$out/$grammar" || exit
+  ./build/parser_generator "$dir/$grammar.txt" "$out/$grammar" || exit
+  for mode in simd scalar; do
+    flags=""
+    if [ "$mode" = scalar ]; then
+      flags="-DPARSER_NO_SIMD"
+    fi
+    g++ -std=c++17 -O2 $flags -I"$out/$grammar" "$dir/lexer_bench.cpp" -o "$out/$grammar/bench_$mode" || exit
+    printf "%s, %s " "$grammar" "$mode"
+    "$out/$grammar/bench_$mode" "$input" || exit
+  done
+done
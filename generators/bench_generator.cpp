@@ -0,0 +1,217 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "bench_generator.h"
+#include "profile_generator.h"
+
+bench_generator::bench_generator(const generator_options &options, std::string start)
+  : options(options)
+  , start(std::move(start)) {}
+
+/**
+ * Replaced global operator new counts allocations of the whole program, the driver takes the difference around parses.
+ * The counter is atomic, lexer threads of --parallel-lex allocate at the same time as the parse
+ */
+std::string bench_generator::generate_allocation_counter() const {
+  return
+    "static std::atomic<size_t> allocations{0};\n"
+    "\n" +
+    profile_generator::generate_allocation_hooks(
+      options.profile
+        ? "\tallocations.fetch_add(1, std::memory_order_relaxed);\n\tprofile_.bytes += size;\n"
+        : "\tallocations.fetch_add(1, std::memory_order_relaxed);\n");
+}
+
+/**
+ * Nodes of the tree are counted by the explicit stack, so deep trees are counted without recursion
+ */
+std::string bench_generator::generate_node_counter() const {
+  if (options.actions_only || options.flat) {
+    return "";
+  }
+  std::string push_children = options.arena
+    ? "\t\tfor (base_node *child = static_cast<inner_node *>(node)->first_child; child != nullptr; child = child->next_sibling) {\n"
+      "\t\t\tstack.push_back(child);\n"
+      "\t\t}\n"
+    : "\t\tfor (const auto &child: static_cast<inner_node *>(node)->children) {\n"
+      "\t\t\tstack.push_back(child.get());\n"
+      "\t\t}\n";
+  return
+    "static size_t count_nodes(base_node &root) {\n"
+    "\tsize_t count = 0;\n"
+    "\tstd::vector<base_node *> stack{&root};\n"
+    "\twhile (!stack.empty()) {\n"
+    "\t\tbase_node *node = stack.back();\n"
+    "\t\tstack.pop_back();\n"
+    "\t\tcount++;\n"
+    "\t\tif (node->kind == NODE_KIND::TEXT) {\n"
+    "\t\t\tcontinue;\n"
+    "\t\t}\n" +
+    push_children +
+    "\t}\n"
+    "\treturn count;\n"
+    "}\n"
+    "\n";
+}
+
+/**
+ * The first pass over the corpus is not timed, it counts nodes and rejected inputs. Every timed parse includes
+ * destruction of its result, the copy of the input taken by parse is made before the timer starts.
+ * Tokens are counted by the lexer automaton alone, so they do not depend on the parser mode.
+ */
+std::string bench_generator::generate() const {
+  std::string state, state_arg, accepted = "true", reset;
+  if (options.arena) {
+    state += "\tnode_arena arena;\n";
+    state_arg += ", arena";
+    reset += "\t\tarena.release();\n";
+  }
+  if (options.recover) {
+    state += "\tstd::vector<parse_error> errors;\n";
+    state_arg += ", errors";
+    accepted = "errors.empty()";
+    reset += "\t\terrors.clear();\n";
+  }
+  if (options.no_exceptions) {
+    state += "\tparse_status status;\n";
+    state_arg += ", status";
+    accepted = "static_cast<bool>(status)";
+    reset += "\t\tstatus = parse_status();\n";
+  }
+  std::string count_nodes = "count_nodes(*node)";
+  if (options.flat) {
+    count_nodes = "node.nodes.size()";
+  } else if (options.actions_only) {
+    count_nodes = "0";
+  }
+  std::string text = options.spans ? "\t\tstd::string_view text = input;\n" : "\t\tstd::string text = input;\n";
+  // Without the tree only rule values exist, they are not counted
+  std::string nodes_per_parse = options.actions_only && !options.flat
+    ? "\t\t<< \"\\t\\\"nodes_per_parse\\\": null,\\n\"\n"
+    : "\t\t<< \"\\t\\\"nodes_per_parse\\\": \" << static_cast<double>(nodes) / std::max<double>(1, corpus.size() - rejected)"
+      " << \",\\n\"\n";
+
+  return
+    generate_allocation_counter() +
+    generate_node_counter() +
+    "// Parses files from the arguments or, with --records, their non-empty lines, and prints the results as JSON\n"
+    "int main(int argc, char **argv) {\n"
+    "\tsize_t warmup = 1, iterations = 10;\n"
+    "\tbool records = false;\n"
+    "\tstd::vector<std::string> corpus;\n"
+    "\tfor (int i = 1; i < argc; i++) {\n"
+    "\t\tstd::string arg = argv[i];\n"
+    "\t\tif (arg == \"--warmup\" && i + 1 < argc) {\n"
+    "\t\t\twarmup = std::stoul(argv[++i]);\n"
+    "\t\t\tcontinue;\n"
+    "\t\t} else if (arg == \"--iterations\" && i + 1 < argc) {\n"
+    "\t\t\titerations = std::stoul(argv[++i]);\n"
+    "\t\t\tcontinue;\n"
+    "\t\t} else if (arg == \"--records\") {\n"
+    "\t\t\trecords = true;\n"
+    "\t\t\tcontinue;\n"
+    "\t\t}\n"
+    "\t\tstd::ifstream in(arg, std::ios::binary);\n"
+    "\t\tif (!in) {\n"
+    "\t\t\tstd::cerr << \"File \" << arg << \" can not be read\" << std::endl;\n"
+    "\t\t\treturn 1;\n"
+    "\t\t}\n"
+    "\t\tstd::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};\n"
+    "\t\tif (!records) {\n"
+    "\t\t\tcorpus.push_back(std::move(data));\n"
+    "\t\t\tcontinue;\n"
+    "\t\t}\n"
+    "\t\tstd::istringstream lines(data);\n"
+    "\t\tfor (std::string line; std::getline(lines, line);) {\n"
+    "\t\t\tif (!line.empty()) {\n"
+    "\t\t\t\tcorpus.push_back(std::move(line));\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\tif (corpus.empty() || iterations == 0) {\n"
+    "\t\tstd::cerr << \"Usage: \" << argv[0] << \" [--warmup N] [--iterations N] [--records] files...\" << std::endl;\n"
+    "\t\treturn 1;\n"
+    "\t}\n"
+    "\n"
+    "\tsize_t bytes = 0, tokens = 0;\n"
+    "\tfor (const auto &input: corpus) {\n"
+    "\t\tbytes += input.size();\n"
+    "\t\tfor (size_t pos = 0; pos < input.size(); tokens++) {\n"
+    "\t\t\tTOKEN_TYPE type = TOKEN_TYPE::END;\n"
+    "\t\t\tbool at_end = false;\n"
+    "\t\t\tsize_t len = lexer::match(input.data() + pos, input.data() + input.size(), type, at_end);\n"
+    "\t\t\tif (len == 0) {\n"
+    "\t\t\t\tbreak;\n"
+    "\t\t\t}\n"
+    "\t\t\tpos += len;\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\n" +
+    state +
+    "\tsize_t nodes = 0, rejected = 0, parse_allocations = 0;\n"
+    "\tstd::vector<uint64_t> latencies;\n"
+    "\tlatencies.reserve(corpus.size() * iterations);\n"
+    "\t// Returns the time of the parse in nanoseconds\n"
+    "\tauto run = [&](const std::string &input, bool first, bool timed) {\n" +
+    text +
+    "\t\tsize_t allocations_before = allocations.load();\n"
+    "\t\tauto begin = std::chrono::steady_clock::now();\n"
+    "\t\ttry {\n"
+    "\t\t\t[[maybe_unused]] auto node = parse(std::move(text)" + state_arg + ");\n"
+    "\t\t\tif (first && " + accepted + ") {\n"
+    "\t\t\t\tnodes += " + count_nodes + ";\n"
+    "\t\t\t} else if (first) {\n"
+    "\t\t\t\trejected++;\n"
+    "\t\t\t}\n"
+    "\t\t} catch (const std::exception &) {\n"
+    "\t\t\trejected += first;\n"
+    "\t\t}\n" +
+    reset +
+    "\t\tauto end = std::chrono::steady_clock::now();\n"
+    "\t\tif (timed) {\n"
+    "\t\t\tparse_allocations += allocations.load() - allocations_before;\n"
+    "\t\t\tlatencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());\n"
+    "\t\t}\n"
+    "\t};\n"
+    "\tfor (const auto &input: corpus) {\n"
+    "\t\trun(input, true, false);\n"
+    "\t}\n"
+    "\tfor (size_t i = 0; i < warmup; i++) {\n"
+    "\t\tfor (const auto &input: corpus) {\n"
+    "\t\t\trun(input, false, false);\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\tfor (size_t i = 0; i < iterations; i++) {\n"
+    "\t\tfor (const auto &input: corpus) {\n"
+    "\t\t\trun(input, false, true);\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\n"
+    "\tdouble seconds = std::accumulate(latencies.begin(), latencies.end(), 0.0) / 1e9;\n"
+    "\tdouble parses = static_cast<double>(latencies.size());\n"
+    "\tstd::sort(latencies.begin(), latencies.end());\n"
+    "\tauto percentile = [&](size_t p) {\n"
+    "\t\treturn latencies[std::min(latencies.size() - 1, latencies.size() * p / 100)];\n"
+    "\t};\n"
+    "\tstd::cout << std::fixed\n"
+    "\t\t<< \"{\\n\"\n"
+    "\t\t<< \"\\t\\\"parser\\\": \\\"" + start + "\\\",\\n\"\n"
+    "\t\t<< \"\\t\\\"inputs\\\": \" << corpus.size() << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"rejected\\\": \" << rejected << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"bytes\\\": \" << bytes << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"tokens\\\": \" << tokens << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"warmup\\\": \" << warmup << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"iterations\\\": \" << iterations << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"seconds\\\": \" << seconds << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"bytes_per_second\\\": \" << static_cast<double>(bytes * iterations) / seconds << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"tokens_per_second\\\": \" << static_cast<double>(tokens * iterations) / seconds << \",\\n\"\n" +
+    nodes_per_parse +
+    "\t\t<< \"\\t\\\"allocations_per_parse\\\": \" << static_cast<double>(parse_allocations) / parses << \",\\n\"\n"
+    "\t\t<< \"\\t\\\"latency_ns\\\": {\\\"p50\\\": \" << percentile(50) << \", \\\"p99\\\": \" << percentile(99)\n"
+    "\t\t<< \", \\\"max\\\": \" << latencies.back() << \"}\\n\"\n"
+    "\t\t<< \"}\" << std::endl;\n" +
+    (options.profile ? profile_generator::generate_main_epilogue() : "") +
+    "\treturn 0;\n"
+    "}\n";
+}
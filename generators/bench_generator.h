@@ -0,0 +1,29 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_GENERATORS_BENCH_GENERATOR_H_
+#define PARSER_GENERATOR_GENERATORS_BENCH_GENERATOR_H_
+
+#include <string>
+#include "generator_options.h"
+
+/**
+ * Generates main of the benchmark driver (--bench) instead of the one parsing a single line:
+ * the corpus is parsed in timed iterations and the throughput, tree size, allocations and latency are printed as JSON
+ */
+class bench_generator {
+ public:
+  bench_generator(const generator_options &options, std::string start);
+
+  std::string generate() const;
+
+ private:
+  generator_options options;
+  std::string start;
+
+  std::string generate_allocation_counter() const;
+  std::string generate_node_counter() const;
+};
+
+#endif //PARSER_GENERATOR_GENERATORS_BENCH_GENERATOR_H_
@@ -0,0 +1,181 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "dfa.h"
+#include <algorithm>
+#include <map>
+
+/**
+ * Subset construction, DFA state i corresponds to the eps-closure subsets[i] of nfa states
+ */
+dfa::dfa(const nfa &automaton) {
+  const auto &nfa_states = automaton.get_states();
+  std::vector<size_t> used(nfa_states.size(), 0);
+  size_t closure_id = 0;
+  auto eps_closure = [&](const std::vector<size_t> &from) {
+    closure_id++;
+    std::vector<size_t> closure, stack;
+    for (size_t state: from) {
+      if (used[state] != closure_id) {
+        used[state] = closure_id;
+        stack.push_back(state);
+      }
+    }
+    while (!stack.empty()) {
+      size_t state = stack.back();
+      stack.pop_back();
+      closure.push_back(state);
+      for (size_t to: nfa_states[state].eps_transitions) {
+        if (used[to] != closure_id) {
+          used[to] = closure_id;
+          stack.push_back(to);
+        }
+      }
+    }
+    std::sort(closure.begin(), closure.end());
+    return closure;
+  };
+
+  std::vector<std::vector<size_t>> subsets;
+  std::map<std::vector<size_t>, size_t> subset_ids;
+  auto get_state = [&](std::vector<size_t> subset) {
+    auto it = subset_ids.find(subset);
+    if (it != subset_ids.end()) {
+      return it->second;
+    }
+    size_t token = nfa::NO_TOKEN;
+    for (size_t state: subset) {
+      token = std::min(token, nfa_states[state].token);
+    }
+    transitions.emplace_back();
+    transitions.back().fill(DEAD);
+    tokens.push_back(token);
+    subset_ids.emplace(subset, subsets.size());
+    subsets.push_back(std::move(subset));
+    return subsets.size() - 1;
+  };
+
+  get_state({});
+  get_state(eps_closure({automaton.get_start()}));
+  for (size_t i = START; i < subsets.size(); i++) {
+    std::array<std::vector<size_t>, 256> moves;
+    for (size_t state: subsets[i]) {
+      for (const auto&[chars, to]: nfa_states[state].transitions) {
+        for (size_t c = 0; c < chars.size(); c++) {
+          if (chars.test(c)) {
+            moves[c].push_back(to);
+          }
+        }
+      }
+    }
+
+    std::map<std::vector<size_t>, size_t> move_states;
+    for (size_t c = 0; c < moves.size(); c++) {
+      std::sort(moves[c].begin(), moves[c].end());
+      moves[c].erase(std::unique(moves[c].begin(), moves[c].end()), moves[c].end());
+      auto it = move_states.find(moves[c]);
+      if (it == move_states.end()) {
+        it = move_states.emplace(moves[c], get_state(eps_closure(moves[c]))).first;
+      }
+      transitions[i][c] = it->second;
+    }
+  }
+  minimize();
+  init_char_classes();
+}
+
+/**
+ * Moore's algorithm: split states by accepted token and then by classes of successors until nothing changes
+ */
+void dfa::minimize() {
+  std::vector<size_t> classes(size());
+  size_t classes_count;
+  {
+    std::map<size_t, size_t> token_classes;
+    for (size_t state = 0; state < size(); state++) {
+      classes[state] = token_classes.emplace(tokens[state], token_classes.size()).first->second;
+    }
+    classes_count = token_classes.size();
+  }
+
+  while (true) {
+    std::map<std::vector<size_t>, size_t> signatures;
+    std::vector<size_t> new_classes(size());
+    for (size_t state = 0; state < size(); state++) {
+      std::vector<size_t> signature{classes[state]};
+      for (size_t to: transitions[state]) {
+        signature.push_back(classes[to]);
+      }
+      new_classes[state] = signatures.emplace(signature, signatures.size()).first->second;
+    }
+    classes.swap(new_classes);
+    if (signatures.size() == classes_count) {
+      break;
+    }
+    classes_count = signatures.size();
+  }
+
+  if (classes[START] == classes[DEAD]) { // Nothing can be accepted
+    transitions.assign(2, {});
+    transitions[DEAD].fill(DEAD);
+    transitions[START].fill(DEAD);
+    tokens.assign(2, nfa::NO_TOKEN);
+    return;
+  }
+
+  std::vector<size_t> ids(classes_count, static_cast<size_t>(-1));
+  ids[classes[DEAD]] = DEAD;
+  ids[classes[START]] = START;
+  size_t ids_count = 2;
+  std::vector<std::array<size_t, 256>> new_transitions(classes_count);
+  std::vector<size_t> new_tokens(classes_count);
+  for (size_t state = 0; state < size(); state++) {
+    size_t &id = ids[classes[state]];
+    if (id == static_cast<size_t>(-1)) {
+      id = ids_count++;
+    }
+  }
+  for (size_t state = 0; state < size(); state++) {
+    size_t id = ids[classes[state]];
+    for (size_t c = 0; c < transitions[state].size(); c++) {
+      new_transitions[id][c] = ids[classes[transitions[state][c]]];
+    }
+    new_tokens[id] = tokens[state];
+  }
+  transitions.swap(new_transitions);
+  tokens.swap(new_tokens);
+}
+
+void dfa::init_char_classes() {
+  std::map<std::vector<size_t>, size_t> columns;
+  for (size_t c = 0; c < char_classes.size(); c++) {
+    std::vector<size_t> column;
+    column.reserve(size());
+    for (const auto &state_transitions: transitions) {
+      column.push_back(state_transitions[c]);
+    }
+    char_classes[c] = columns.emplace(column, columns.size()).first->second;
+  }
+  char_classes_count = columns.size();
+}
+
+size_t dfa::size() const {
+  return transitions.size();
+}
+
+size_t dfa::next(size_t state, unsigned char c) const {
+  return transitions[state][c];
+}
+
+size_t dfa::get_token(size_t state) const {
+  return tokens[state];
+}
+
+size_t dfa::get_char_class(unsigned char c) const {
+  return char_classes[c];
+}
+
+size_t dfa::get_char_classes_count() const {
+  return char_classes_count;
+}
@@ -0,0 +1,40 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_GENERATORS_DFA_H_
+#define PARSER_GENERATOR_GENERATORS_DFA_H_
+
+#include <array>
+#include <vector>
+#include "nfa.h"
+
+/**
+ * Minimized deterministic automaton built from nfa.
+ * State DEAD has no way to the final states, every final state accepts the token with the least id.
+ * Characters with equal transitions from every state share the same class, so the tables may be indexed by classes.
+ */
+class dfa {
+ public:
+  static constexpr size_t DEAD = 0;
+  static constexpr size_t START = 1;
+
+  explicit dfa(const nfa &automaton);
+
+  size_t size() const;
+  size_t next(size_t state, unsigned char c) const;
+  size_t get_token(size_t state) const;
+  size_t get_char_class(unsigned char c) const;
+  size_t get_char_classes_count() const;
+
+ private:
+  std::vector<std::array<size_t, 256>> transitions;
+  std::vector<size_t> tokens;
+  std::array<size_t, 256> char_classes;
+  size_t char_classes_count;
+
+  void minimize();
+  void init_char_classes();
+};
+
+#endif //PARSER_GENERATOR_GENERATORS_DFA_H_
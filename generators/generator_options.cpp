@@ -0,0 +1,90 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "generator_options.h"
+#include <stdexcept>
+
+generator_options generator_options::parse(const std::vector<std::string> &args) {
+  generator_options options;
+  for (size_t i = 0; i < args.size(); i++) {
+    const std::string &arg = args[i];
+    if (arg == "--spans") {
+      options.spans = true;
+    } else if (arg == "--constexpr") {
+      options.constexpr_parser = true;
+      options.spans = true;
+      options.actions_only = true;
+    } else if (arg == "--pretokenize") {
+      options.pretokenize = true;
+    } else if (arg == "--parallel-lex") {
+      options.parallel_lex = true;
+      options.pretokenize = true;
+    } else if (arg == "--arena") {
+      options.arena = true;
+    } else if (arg == "--actions-only") {
+      options.actions_only = true;
+    } else if (arg == "--flat") {
+      options.flat = true;
+    } else if (arg == "--table") {
+      options.table = true;
+    } else if (arg == "--push") {
+      options.push = true;
+      options.table = true;
+    } else if (arg == "--no-exceptions") {
+      options.no_exceptions = true;
+    } else if (arg == "--recover") {
+      options.recover = true;
+    } else if (arg == "--bench") {
+      options.bench = true;
+    } else if (arg == "--profile") {
+      options.profile = true;
+    } else if (arg == "--pgo") {
+      if (i + 1 == args.size()) {
+        throw std::runtime_error("Option --pgo expects the profile file");
+      }
+      options.pgo = args[++i];
+    } else if (arg == "--incremental") {
+      options.incremental = true;
+      options.pretokenize = true;
+    } else {
+      throw std::runtime_error("Unknown option " + arg);
+    }
+  }
+  if (options.constexpr_parser && options.pretokenize) {
+    throw std::runtime_error("Options --pretokenize and --parallel-lex can not be used with --constexpr");
+  }
+  if (options.flat && (options.constexpr_parser || options.arena || options.actions_only)) {
+    throw std::runtime_error("Option --flat can not be used with --constexpr, --arena or --actions-only");
+  }
+  // Reused subtrees must own their text and be shared between the old and the new tree
+  if (options.incremental && (options.spans || options.constexpr_parser || options.arena || options.actions_only
+    || options.flat || options.table)) {
+    throw std::runtime_error("Option --incremental can be used only with the default tree and without --spans");
+  }
+  if (options.recover && (options.constexpr_parser || options.table || options.incremental)) {
+    throw std::runtime_error("Option --recover can not be used with --constexpr, --table or --incremental");
+  }
+  if (options.no_exceptions && (options.constexpr_parser || options.parallel_lex || options.table
+    || options.incremental || options.recover)) {
+    throw std::runtime_error(
+      "Option --no-exceptions can not be used with --constexpr, --parallel-lex, --table, --incremental or --recover");
+  }
+  // Tokens are copied out of the chunks and nothing growing with the input may be kept
+  if (options.push && (options.spans || options.pretokenize || options.flat)) {
+    throw std::runtime_error("Option --push can not be used with --spans, --pretokenize, --parallel-lex or --flat");
+  }
+  // Counters are thread-local and read the clock, neither is allowed in constant expressions
+  if (options.profile && options.constexpr_parser) {
+    throw std::runtime_error("Option --profile can not be used with --constexpr");
+  }
+  if (options.table && (options.constexpr_parser || options.arena)) {
+    throw std::runtime_error("Option --table can not be used with --constexpr or --arena");
+  }
+  // Flat tree is built next to tree-less rule values, the table parser keeps rule values on its stack
+  options.actions_only |= options.flat || options.table;
+  if (options.actions_only && options.arena) {
+    throw std::runtime_error("Option --arena can not be used with --actions-only or --constexpr, no tree is built");
+  }
+  return options;
+}
@@ -0,0 +1,51 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_GENERATORS_GENERATOR_OPTIONS_H_
+#define PARSER_GENERATOR_GENERATORS_GENERATOR_OPTIONS_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * Generation modes passed to the generator after the grammar file and the output folder
+ */
+struct generator_options {
+  // --spans: tokens and text nodes are views into the input instead of owned strings
+  bool spans = false;
+  // --constexpr: header-only C++20 parser usable in constant expressions, implies --spans and --actions-only
+  bool constexpr_parser = false;
+  // --pretokenize: the whole input is lexed into arrays of token kinds, offsets and lengths before parsing
+  bool pretokenize = false;
+  // --parallel-lex: pre-tokenization of large inputs is split between threads, implies --pretokenize
+  bool parallel_lex = false;
+  // --arena: tree nodes are allocated from node_arena, children are non-owning pointers
+  bool arena = false;
+  // --actions-only: no tree is built, rules are local values passing variables to the parent rule
+  bool actions_only = false;
+  // --flat: the tree is a preorder array of fixed-size nodes with rule variables in per-rule side tables
+  bool flat = false;
+  // --table: rules are parsed by the loop over the predict table with an explicit stack, implies --actions-only
+  // unless --flat is used
+  bool table = false;
+  // --push: the table parser is fed by chunks of the input and reports rules and tokens to callbacks, implies --table
+  bool push = false;
+  // --incremental: the tree keeps token counts of nodes and is reparsed after edits reusing unchanged subtrees,
+  // implies --pretokenize
+  bool incremental = false;
+  // --recover: syntax errors are collected, the parser skips tokens until FOLLOW of the current rule and continues
+  bool recover = false;
+  // --no-exceptions: parse functions are noexcept and return error codes, details are kept in parse_status
+  bool no_exceptions = false;
+  // --bench: gen.cpp gets the benchmark driver parsing a corpus instead of main parsing a single input
+  bool bench = false;
+  // --profile: rules and actions count calls, time, tokens and allocated bytes in thread-local counters
+  bool profile = false;
+  // --pgo <file>: alternatives are ordered and marked hot or cold by the numbers of calls saved by --profile
+  std::string pgo;
+
+  static generator_options parse(const std::vector<std::string> &args);
+};
+
+#endif //PARSER_GENERATOR_GENERATORS_GENERATOR_OPTIONS_H_
@@ -3,121 +3,863 @@
 //
 
 #include "lexer_generator.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include "dfa.h"
+#include "nfa.h"
+#include "run_kernels.h"
 #include "../utils/utils.h"
 
+lexer_generator::lexer_generator(const generator_options &options)
+  : options(options) {}
+
 void lexer_generator::add_token(const std::string &token_text) {
   tokens.insert(token_text);
 }
 
 void lexer_generator::add_regex(const std::string &regex_name, const std::string &regex) {
-  if (regex_name == "END") {
-    throw std::runtime_error("END is reserved name for regex");
+  bool literal_type = regex_name.size() > 5 && regex_name.compare(0, 5, "TEXT_") == 0 &&
+    std::all_of(regex_name.begin() + 5, regex_name.end(), [](char c) { return std::isdigit(c); });
+  if (regex_name == "END" || literal_type) {
+    throw std::runtime_error("END and TEXT_<number> are reserved names for regex");
   }
-  if (!regexes.emplace(regex_name, regex).second) {
+  auto same_name = [&regex_name](const auto &named_regex) { return named_regex.first == regex_name; };
+  if (std::any_of(regexes.begin(), regexes.end(), same_name)) {
     throw std::runtime_error("Duplicate regex name:\n" + regex_name);
   }
+  regexes.emplace_back(regex_name, regex);
+}
+
+/**
+ * Every literal has its own token type TEXT_<index of the literal>, so rules dispatch by switch on the type
+ */
+std::string lexer_generator::get_literal_type(const std::string &literal) const {
+  auto it = tokens.find(literal);
+  if (it == tokens.end()) {
+    throw std::runtime_error("Unknown literal '" + literal + "'");
+  }
+  return "TEXT_" + std::to_string(std::distance(tokens.begin(), it));
 }
 
-std::string generate_token_types(const std::unordered_map<std::string, std::string> &regexes) {
+/**
+ * Names of token types in the order of TOKEN_TYPE values
+ */
+std::vector<std::string> lexer_generator::get_token_types() const {
+  std::vector<std::string> type_names;
+  for (const auto&[regex_name, regex]: regexes) {
+    type_names.push_back(regex_name);
+  }
+  type_names.emplace_back("END");
+  for (const auto &token: tokens) {
+    type_names.push_back(get_literal_type(token));
+  }
+  return type_names;
+}
+
+std::string generate_token_types(const std::vector<std::pair<std::string, std::string>> &regexes,
+                                 const std::set<std::string> &tokens) {
   std::string res;
   res += "enum class TOKEN_TYPE {\n";
   for (const auto&[regex_name, regex]: regexes) {
     res += "\t" + regex_name + ",\n";
   }
-  res +=
-    "\tEND\n,"
-    "\tTEXT\n"
-    "};\n";
+  res += "\tEND,\n";
+  size_t literal_id = 0;
+  for (const auto &token: tokens) {
+    res += "\tTEXT_" + std::to_string(literal_id++) + ", // '" + escape(token) + "'\n";
+  }
+  res += "};\n";
   return res;
 }
 
-std::string generate_regexes(const std::unordered_map<std::string, std::string> &regexes) {
-  std::string res;
-  for (auto it = regexes.begin(); it != regexes.end(); ++it) {
-    if (it != regexes.begin()) {
-      res += ", ";
+/**
+ * Type of token text. With --spans the text is a view into the input, it is converted to std::string only on demand
+ */
+std::string generate_text_type(const generator_options &options) {
+  if (!options.spans) {
+    return
+      "using text_t = std::string;\n"
+      "using token_t = std::pair<TOKEN_TYPE, text_t>;\n"
+      "\n";
+  }
+  std::string constexpr_ = options.constexpr_parser ? "constexpr " : "";
+  return
+    "struct token_text : public std::string_view {\n"
+    "\t" + constexpr_ + "token_text() = default;\n"
+    "\n"
+    "\t" + constexpr_ + "token_text(std::string_view view) : std::string_view(view) {}\n"
+    "\n"
+    "\t" + constexpr_ + "token_text(const char *text) : std::string_view(text) {}\n"
+    "\n"
+    "\t" + constexpr_ + "operator std::string() const {\n"
+    "\t\treturn std::string(data(), size());\n"
+    "\t}\n"
+    "};\n"
+    "\n"
+    "inline " + constexpr_ + "std::string operator+(const std::string &lhs, const token_text &rhs) {\n"
+    "\treturn lhs + std::string(rhs);\n"
+    "}\n"
+    "\n"
+    "inline " + constexpr_ + "std::string operator+(const token_text &lhs, const std::string &rhs) {\n"
+    "\treturn std::string(lhs) + rhs;\n"
+    "}\n"
+    "\n"
+    "inline " + constexpr_ + "std::string operator+(const token_text &lhs, const token_text &rhs) {\n"
+    "\treturn std::string(lhs) + std::string(rhs);\n"
+    "}\n"
+    "\n"
+    "inline " + constexpr_ + "std::string operator+(const char *lhs, const token_text &rhs) {\n"
+    "\treturn lhs + std::string(rhs);\n"
+    "}\n"
+    "\n"
+    "inline " + constexpr_ + "std::string operator+(const token_text &lhs, const char *rhs) {\n"
+    "\treturn std::string(lhs) + rhs;\n"
+    "}\n"
+    "\n"
+    "using text_t = token_text;\n"
+    "using token_t = std::pair<TOKEN_TYPE, text_t>;\n"
+    "\n";
+}
+
+/**
+ * Read-only memory mapping of the input file, it must outlive the lexer reading it.
+ * Only regular files are mapped, pipes and other files without a known size are rejected
+ */
+std::string generate_mapped_file() {
+  return
+    "struct mapped_file {\n"
+    "\texplicit mapped_file(const std::string &path) {\n"
+    "\t\tint fd = ::open(path.c_str(), O_RDONLY);\n"
+    "\t\tif (fd == -1) {\n"
+    "\t\t\tthrow std::runtime_error(\"File \" + path + \" can not be opened\");\n"
+    "\t\t}\n"
+    "\t\tstruct stat file_stat{};\n"
+    "\t\tbool regular = ::fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode);\n"
+    "\t\tif (regular && file_stat.st_size > 0) {\n"
+    "\t\t\tsize = static_cast<size_t>(file_stat.st_size);\n"
+    "\t\t\taddr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);\n"
+    "\t\t}\n"
+    "\t\t::close(fd);\n"
+    "\t\tif (!regular || addr == MAP_FAILED) {\n"
+    "\t\t\tthrow std::runtime_error(\"File \" + path + \" can not be mapped\");\n"
+    "\t\t}\n"
+    "\t\tif (size != 0) {\n"
+    "\t\t\t::madvise(addr, size, MADV_SEQUENTIAL);\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\n"
+    "\tmapped_file(const mapped_file &) = delete;\n"
+    "\tmapped_file &operator=(const mapped_file &) = delete;\n"
+    "\n"
+    "\t~mapped_file() {\n"
+    "\t\tif (size != 0) {\n"
+    "\t\t\t::munmap(addr, size);\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\n"
+    "\tstd::string_view view() const {\n"
+    "\t\treturn {static_cast<const char *>(addr), size};\n"
+    "\t}\n"
+    "\n"
+    " private:\n"
+    "\tvoid *addr = nullptr;\n"
+    "\tsize_t size = 0;\n"
+    "};\n"
+    "\n";
+}
+
+/**
+ * Smallest unsigned type able to store every DFA state
+ */
+std::string state_type(size_t states_count) {
+  if (states_count <= 0x100) {
+    return "uint8_t";
+  } else if (states_count <= 0x10000) {
+    return "uint16_t";
+  }
+  return "uint32_t";
+}
+
+std::string generate_dfa_tables(const dfa &lexer_dfa, const std::vector<std::string> &token_types) {
+  std::string state_t = state_type(lexer_dfa.size());
+  std::string classes_count = std::to_string(lexer_dfa.get_char_classes_count());
+  std::string code =
+    "\tstatic constexpr " + state_t + " DEAD_STATE = " + std::to_string(dfa::DEAD) + ";\n"
+    "\tstatic constexpr " + state_t + " START_STATE = " + std::to_string(dfa::START) + ";\n"
+    "\tstatic constexpr " + state_type(lexer_dfa.get_char_classes_count()) + " char_classes[256] = {";
+  for (size_t c = 0; c < 256; c++) {
+    code += (c % 32 == 0 ? "\n\t\t" : " ") + std::to_string(lexer_dfa.get_char_class(static_cast<unsigned char>(c))) + ",";
+  }
+  code +=
+    "\n"
+    "\t};\n"
+    "\tstatic constexpr " + state_t + " transitions[" + std::to_string(lexer_dfa.size()) + "][" + classes_count + "] = {\n";
+  std::vector<unsigned char> class_chars(lexer_dfa.get_char_classes_count());
+  for (size_t c = 256; c-- > 0;) {
+    class_chars[lexer_dfa.get_char_class(static_cast<unsigned char>(c))] = static_cast<unsigned char>(c);
+  }
+  for (size_t state = 0; state < lexer_dfa.size(); state++) {
+    code += "\t\t{";
+    for (size_t char_class = 0; char_class < class_chars.size(); char_class++) {
+      code += (char_class == 0 ? "" : ", ") + std::to_string(lexer_dfa.next(state, class_chars[char_class]));
     }
-    res += "{TOKEN_TYPE::" + it->first + ", std::regex(\"" + it->second + "\")}";
+    code += "},\n";
   }
-  return "{" + res + "}";
+  code +=
+    "\t};\n"
+    "\tstatic constexpr TOKEN_TYPE accepts[" + std::to_string(lexer_dfa.size()) + "] = {\n";
+  for (size_t state = 0; state < lexer_dfa.size(); state++) {
+    size_t token = lexer_dfa.get_token(state);
+    code += "\t\tTOKEN_TYPE::" + (token == nfa::NO_TOKEN ? std::string("END") : token_types[token]) + ",\n";
+  }
+  code += "\t};\n";
+  return code;
 }
 
-std::string lexer_generator::generate() {
-  size_t max_token_len = 0;
+/**
+ * Number of tokens and the dump of pre-tokenized input, one token per line: index, type, offset, length and text
+ */
+std::string generate_pretokenized_api(const std::string &input) {
+  return
+    "\tsize_t tokens_count() const {\n"
+    "\t\treturn kinds.size();\n"
+    "\t}\n"
+    "\n"
+    "\tvoid dump(std::ostream &out) const {\n"
+    "\t\tfor (size_t i = 0; i < kinds.size(); i++) {\n"
+    "\t\t\tout << i << '\\t' << token_type_names[kinds[i]] << '\\t' << starts[i] << '\\t' << lengths[i] << '\\t'\n"
+    "\t\t\t\t<< " + input + ".substr(starts[i], lengths[i]) << '\\n';\n"
+    "\t\t}\n"
+    "\t}\n";
+}
+
+/**
+ * With --no-exceptions the lexer does not throw: an unexpected character is reported as the end of the input,
+ * and the parser checks failed() when it stops. Descriptions of token types are used in lazily built messages.
+ */
+std::string generate_token_descriptions(size_t types_count,
+                                        const std::vector<std::pair<std::string, std::string>> &regexes,
+                                        const std::set<std::string> &tokens) {
+  std::string code = "\tstatic constexpr const char *token_descriptions[" + std::to_string(types_count) + "] = {";
+  for (const auto&[regex_name, regex]: regexes) {
+    code += "\"" + regex_name + "\", ";
+  }
+  code += "\"EOF\"";
   for (const auto &token: tokens) {
-    max_token_len = std::max(max_token_len, token.size());
+    code += ", \"'" + escape(token) + "'\"";
   }
+  return
+    code + "};\n"
+    "\n"
+    "\tbool failed() const noexcept {\n"
+    "\t\treturn failed_at != std::numeric_limits<size_t>::max();\n"
+    "\t}\n"
+    "\n"
+    "\t// Offset of the character which does not start any token\n"
+    "\tsize_t error_position() const noexcept {\n"
+    "\t\treturn failed_at;\n"
+    "\t}\n"
+    "\n";
+}
 
-  std::string code =
-    generate_token_types(regexes) +
-    "class lexer {\n"
-    " public:\n"
+/**
+ * With --incremental the lexer relexes only tokens which read edited bytes. reach[i] is the furthest byte read by
+ * the DFA while lexing tokens up to i, including the byte rejecting the token or the end of the input,
+ * so the first damaged token is the first one whose reach is beyond the edit offset.
+ * Relexing stops when a new token starts after the inserted text where some old token started.
+ */
+std::string generate_relex(const std::string &kind_t) {
+  return
     "\n"
-    "\tvoid undo() {\n"
-    "\t\tpos = prev_pos;\n"
+    "\t// Index of the next token\n"
+    "\tsize_t token_position() const {\n"
+    "\t\treturn pos;\n"
     "\t}\n"
     "\n"
-    "\tstd::pair<TOKEN_TYPE, std::string> next() {\n"
-    "\t\tprev_pos = pos;\n"
-    "\t\tif (pos == data.size()) {\n"
-    "\t\t\treturn {TOKEN_TYPE::END, \"\"};\n"
+    "\tvoid seek(size_t token) {\n"
+    "\t\tprev_pos = pos = token;\n"
+    "\t}\n"
+    "\n"
+    "\tstd::string_view text() const {\n"
+    "\t\treturn input();\n"
+    "\t}\n"
+    "\n"
+    "\t// Replaces removed bytes at offset by inserted ones and relexes damaged tokens, seeks to the first token\n"
+    "\treparse_window relex(size_t offset, size_t removed, const std::string &inserted) {\n"
+    "\t\tif (mapped.data() != nullptr) {\n"
+    "\t\t\tbuffer = std::string(mapped);\n"
+    "\t\t\tmapped = {};\n"
+    "\t\t}\n"
+    "\t\tif (offset > buffer.size() || removed > buffer.size() - offset) {\n"
+    "\t\t\tthrow std::out_of_range(\"Edit is out of the input\");\n"
+    "\t\t}\n"
+    "\t\tif (buffer.size() - removed + inserted.size() >= std::numeric_limits<uint32_t>::max()) {\n"
+    "\t\t\tthrow std::runtime_error(\"Input is too large to be pre-tokenized\");\n"
+    "\t\t}\n"
+    "\t\tsize_t old_count = kinds.size();\n"
+    "\t\tsize_t first = std::upper_bound(reach.begin(), reach.end(), offset) - reach.begin();\n"
+    "\t\tsize_t from = first < old_count ? starts[first] : buffer.size();\n"
+    "\t\tstd::string removed_text = buffer.substr(offset, removed);\n"
+    "\t\tbuffer.replace(offset, removed, inserted);\n"
+    "\n"
+    "\t\tstd::string_view data = buffer;\n"
+    "\t\tsize_t edit_end = offset + inserted.size();\n"
+    "\t\tsize_t last = first;\n"
+    "\t\tstd::vector<" + kind_t + "> new_kinds;\n"
+    "\t\tstd::vector<uint32_t> new_starts, new_lengths;\n"
+    "\t\tfor (size_t position = from; ; ) {\n"
+    "\t\t\tif (position == data.size()) {\n"
+    "\t\t\t\tlast = old_count;\n"
+    "\t\t\t\tbreak;\n"
+    "\t\t\t}\n"
+    "\t\t\tif (position >= edit_end) {\n"
+    "\t\t\t\tsize_t old_position = position - inserted.size() + removed;\n"
+    "\t\t\t\twhile (last < old_count && starts[last] < old_position) {\n"
+    "\t\t\t\t\tlast++;\n"
+    "\t\t\t\t}\n"
+    "\t\t\t\tif (last < old_count && starts[last] == old_position) {\n"
+    "\t\t\t\t\tbreak; // The rest of tokens are the same\n"
+    "\t\t\t\t}\n"
+    "\t\t\t}\n"
+    "\t\t\tsize_t next_position = lex_range(data, position, position + 1, new_kinds, new_starts, new_lengths);\n"
+    "\t\t\tif (next_position == position) {\n"
+    "\t\t\t\tbuffer.replace(offset, inserted.size(), removed_text);\n"
+    "\t\t\t\tthrow std::runtime_error(\"Unexpected token\");\n"
+    "\t\t\t}\n"
+    "\t\t\tposition = next_position;\n"
+    "\t\t}\n"
+    "\n"
+    "\t\tuint32_t delta = static_cast<uint32_t>(inserted.size() - removed);\n"
+    "\t\tkinds.erase(kinds.begin() + first, kinds.begin() + last);\n"
+    "\t\tkinds.insert(kinds.begin() + first, new_kinds.begin(), new_kinds.end());\n"
+    "\t\tstarts.erase(starts.begin() + first, starts.begin() + last);\n"
+    "\t\tstarts.insert(starts.begin() + first, new_starts.begin(), new_starts.end());\n"
+    "\t\tlengths.erase(lengths.begin() + first, lengths.begin() + last);\n"
+    "\t\tlengths.insert(lengths.begin() + first, new_lengths.begin(), new_lengths.end());\n"
+    "\t\tsize_t new_last = first + new_kinds.size();\n"
+    "\t\tfor (size_t i = new_last; i < starts.size(); i++) {\n"
+    "\t\t\tstarts[i] += delta;\n"
+    "\t\t}\n"
+    "\t\tstd::vector<uint32_t> tail_reach(reach.begin() + last, reach.end());\n"
+    "\t\textend_reach(first, new_last);\n"
+    "\t\tuint32_t max_reach = new_last == 0 ? 0 : reach[new_last - 1];\n"
+    "\t\tfor (uint32_t old_reach: tail_reach) {\n"
+    "\t\t\treach.push_back(std::max(max_reach, old_reach + delta));\n"
+    "\t\t}\n"
+    "\t\tseek(0);\n"
+    "\n"
+    "\t\tif (last == old_count) { // The end of the input is damaged too\n"
+    "\t\t\treturn {first, old_count + 1, kinds.size() + 1};\n"
+    "\t\t}\n"
+    "\t\treturn {first, last, new_last};\n"
+    "\t}\n";
+}
+
+/**
+ * Computes reach of tokens [from, to), reach of the following tokens is dropped
+ */
+std::string generate_extend_reach() {
+  return
+    "\n"
+    "\tstatic size_t scan_length(std::string_view data, size_t from) {\n"
+    "\t\tsize_t state = START_STATE;\n"
+    "\t\tfor (size_t i = from; i < data.size(); i++) {\n"
+    "\t\t\tstate = transitions[state][char_classes[static_cast<unsigned char>(data[i])]];\n"
+    "\t\t\tif (state == DEAD_STATE) {\n"
+    "\t\t\t\treturn i - from + 1;\n"
+    "\t\t\t}\n"
     "\t\t}\n"
-    "\t\tauto regex_candidate = extract_regex();\n"
-    "\t\tauto token_candidate = extract_token();\n"
-    "\t\tif (regex_candidate.second.size() > token_candidate.second.size()) {\n"
-    "\t\t\tpos += regex_candidate.second.size();\n"
-    "\t\t\treturn regex_candidate;\n"
-    "\t\t} else if (!token_candidate.second.empty()) {\n"
-    "\t\t\tpos += token_candidate.second.size();\n"
-    "\t\t\treturn token_candidate;\n"
+    "\t\treturn data.size() - from + 1; // The end of the input is read too\n"
+    "\t}\n"
+    "\n"
+    "\tvoid extend_reach(size_t from, size_t to) {\n"
+    "\t\tstd::string_view data = input();\n"
+    "\t\treach.resize(from);\n"
+    "\t\tsize_t max_reach = from == 0 ? 0 : reach[from - 1];\n"
+    "\t\tfor (size_t i = from; i < to; i++) {\n"
+    "\t\t\tmax_reach = std::max(max_reach, starts[i] + scan_length(data, starts[i]));\n"
+    "\t\t\treach.push_back(static_cast<uint32_t>(max_reach));\n"
     "\t\t}\n"
-    "\t\tthrow std::runtime_error(\"Unexpected token\");\n"
     "\t}\n"
     "\n"
-    "\tlexer(std::string data)\n"
-    "\t\t: prev_pos(0)\n"
-    "\t\t, pos(0)\n"
-    "\t\t, data(std::move(data))\n"
-    "\t\t, tokens(" + to_string(tokens) + ")\n"
-    "\t\t, regexes(" + generate_regexes(regexes) + ") {}\n"
+    "\tstd::vector<uint32_t> reach;\n";
+}
+
+/**
+ * Speculative parallel lexing: the input is split into chunks starting after a newline where possible,
+ * each chunk is lexed by its own thread as if a token started there. Speculative tokens are taken
+ * from the first one starting where the previous real token ends, until then the chunk is lexed sequentially,
+ * so the result is always the same as of sequential lexing. The speculation started inside a multi-line token
+ * may never meet the real tokens, so they are compared only within SYNC_DISTANCE after the boundary,
+ * then the rest of the chunk is lexed by a single call.
+ */
+std::string generate_parallel_tokenize(const std::string &kind_t) {
+  return
+    "\t\tsize_t threads = std::min<size_t>(std::max<size_t>(1, std::thread::hardware_concurrency()),\n"
+    "\t\t                                  data.size() / MIN_CHUNK_SIZE);\n"
+    "\t\tif (threads < 2) {\n"
+    "\t\t\tif (lex_range(data, 0, data.size(), kinds, starts, lengths) < data.size()) {\n"
+    "\t\t\t\tthrow std::runtime_error(\"Unexpected token\");\n"
+    "\t\t\t}\n"
+    "\t\t\treturn;\n"
+    "\t\t}\n"
+    "\t\tstd::vector<size_t> bounds(threads + 1, data.size());\n"
+    "\t\tfor (size_t i = 1; i < threads; i++) {\n"
+    "\t\t\tbounds[i] = data.size() * i / threads;\n"
+    "\t\t\tsize_t line_end = data.find('\\n', bounds[i]);\n"
+    "\t\t\tif (line_end < data.size() * (i + 1) / threads) {\n"
+    "\t\t\t\tbounds[i] = line_end + 1;\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\n"
+    "\t\tstruct chunk_tokens {\n"
+    "\t\t\tstd::vector<" + kind_t + "> kinds;\n"
+    "\t\t\tstd::vector<uint32_t> starts, lengths;\n"
+    "\t\t};\n"
+    "\t\tstd::vector<chunk_tokens> chunks(threads);\n"
+    "\t\tstd::vector<std::thread> workers;\n"
+    "\t\tfor (size_t i = 1; i < threads; i++) {\n"
+    "\t\t\tworkers.emplace_back([view = data, &bounds, &chunk = chunks[i], i] {\n"
+    "\t\t\t\tlex_range(view, bounds[i], bounds[i + 1], chunk.kinds, chunk.starts, chunk.lengths);\n"
+    "\t\t\t});\n"
+    "\t\t}\n"
+    "\t\tsize_t offset = lex_range(data, 0, bounds[1], kinds, starts, lengths);\n"
+    "\t\tsize_t total = kinds.size();\n"
+    "\t\tfor (size_t i = 1; i < threads; i++) {\n"
+    "\t\t\tworkers[i - 1].join();\n"
+    "\t\t\ttotal += chunks[i].kinds.size();\n"
+    "\t\t}\n"
+    "\t\tkinds.reserve(total);\n"
+    "\t\tstarts.reserve(total);\n"
+    "\t\tlengths.reserve(total);\n"
     "\n"
-    " private:\n"
+    "\t\tfor (size_t i = 1; i < threads; i++) {\n"
+    "\t\t\tconst chunk_tokens &chunk = chunks[i];\n"
+    "\t\t\tsize_t k = std::lower_bound(chunk.starts.begin(), chunk.starts.end(), offset) - chunk.starts.begin();\n"
+    "\t\t\tsize_t sync_end = std::min(bounds[i + 1], offset + SYNC_DISTANCE);\n"
+    "\t\t\twhile (offset < sync_end && k < chunk.starts.size() && chunk.starts[k] != offset) {\n"
+    "\t\t\t\tsize_t next_offset = lex_range(data, offset, chunk.starts[k], kinds, starts, lengths);\n"
+    "\t\t\t\tif (next_offset < chunk.starts[k]) {\n"
+    "\t\t\t\t\tthrow std::runtime_error(\"Unexpected token\");\n"
+    "\t\t\t\t}\n"
+    "\t\t\t\toffset = next_offset;\n"
+    "\t\t\t\twhile (k < chunk.starts.size() && chunk.starts[k] < offset) {\n"
+    "\t\t\t\t\tk++;\n"
+    "\t\t\t\t}\n"
+    "\t\t\t}\n"
+    "\t\t\tif (offset < bounds[i + 1] && k < chunk.starts.size() && chunk.starts[k] == offset) { // Speculation is synchronized\n"
+    "\t\t\t\tkinds.insert(kinds.end(), chunk.kinds.begin() + k, chunk.kinds.end());\n"
+    "\t\t\t\tstarts.insert(starts.end(), chunk.starts.begin() + k, chunk.starts.end());\n"
+    "\t\t\t\tlengths.insert(lengths.end(), chunk.lengths.begin() + k, chunk.lengths.end());\n"
+    "\t\t\t\toffset = starts.back() + lengths.back();\n"
+    "\t\t\t}\n"
+    "\t\t\t// The speculation is out of phase, e.g. it started inside a multi-line token, or stopped at an error\n"
+    "\t\t\tif (offset < bounds[i + 1]) {\n"
+    "\t\t\t\toffset = lex_range(data, offset, bounds[i + 1], kinds, starts, lengths);\n"
+    "\t\t\t\tif (offset < bounds[i + 1]) {\n"
+    "\t\t\t\t\tthrow std::runtime_error(\"Unexpected token\");\n"
+    "\t\t\t\t}\n"
+    "\t\t\t}\n"
+    "\t\t}\n";
+}
+
+/**
+ * With --pretokenize the whole input is split into tokens before parsing, tokens are stored as struct of arrays.
+ * prev_pos and pos are indices of tokens instead of offsets in the input.
+ */
+std::string generate_tokenize(const std::vector<std::string> &type_names,
+                              const std::string &input,
+                              const generator_options &options) {
+  std::string kind_t = state_type(type_names.size());
+  std::string code = "\tstatic constexpr const char *token_type_names[" + std::to_string(type_names.size()) + "] = {";
+  for (size_t i = 0; i < type_names.size(); i++) {
+    code += (i == 0 ? "\"" : ", \"") + type_names[i] + "\"";
+  }
+  code +=
+    "};\n"
     "\n"
-    "\tstd::pair<TOKEN_TYPE, std::string> extract_regex() {\n"
-    "\t\tstd::pair<TOKEN_TYPE, std::string> res;\n"
-    "\t\tfor (const auto&[type, regex]: regexes) {\n"
-    "\t\t\tstd::smatch sm;\n"
-    "\t\t\tauto sdata = data.substr(pos);\n"
-    "\t\t\tstd::regex_search(sdata, sm, regex, std::regex_constants::match_continuous);\n"
-    "\t\t\tif (!sm.empty() && res.second.size() < sm.length(0)) {\n"
-    "\t\t\t\tres = {type, sm[0]};\n"
+    "\t// Appends tokens starting in [from, to), returns where the last token ends or where no token matches\n"
+    "\tstatic size_t lex_range(std::string_view data, size_t from, size_t to, std::vector<" + kind_t + "> &kinds,\n"
+    "\t                        std::vector<uint32_t> &starts, std::vector<uint32_t> &lengths) {\n"
+    "\t\tsize_t offset = from;\n"
+    "\t\twhile (offset < to) {\n"
+    "\t\t\tTOKEN_TYPE type = TOKEN_TYPE::END;\n"
+    "\t\t\tbool at_end = false;\n"
+    "\t\t\tsize_t len = match(data.data() + offset, data.data() + data.size(), type, at_end);\n"
+    "\t\t\tif (len == 0) {\n"
+    "\t\t\t\tbreak;\n"
     "\t\t\t}\n"
+    "\t\t\tkinds.push_back(static_cast<" + kind_t + ">(type));\n"
+    "\t\t\tstarts.push_back(static_cast<uint32_t>(offset));\n"
+    "\t\t\tlengths.push_back(static_cast<uint32_t>(len));\n"
+    "\t\t\toffset += len;\n"
     "\t\t}\n"
-    "\t\treturn res;\n"
+    "\t\treturn offset;\n"
+    "\t}\n"
+    "\n";
+  if (options.parallel_lex) {
+    code +=
+      "\tstatic constexpr size_t MIN_CHUNK_SIZE = 1 << 20;\n"
+      "\t// How far after a chunk boundary the real tokens are compared with the speculative ones\n"
+      "\tstatic constexpr size_t SYNC_DISTANCE = 1 << 16;\n"
+      "\n";
+  }
+  code +=
+    "\tvoid tokenize() {\n" +
+    std::string(options.spans ? "" : "\t\tstd::string_view data = " + input + ";\n") +
+    "\t\tif (data.size() > std::numeric_limits<uint32_t>::max()) {\n"
+    "\t\t\tthrow std::runtime_error(\"Input is too large to be pre-tokenized\");\n"
+    "\t\t}\n";
+  if (options.parallel_lex) {
+    code += generate_parallel_tokenize(kind_t);
+  } else if (options.no_exceptions) {
+    code +=
+      "\t\tsize_t end = lex_range(data, 0, data.size(), kinds, starts, lengths);\n"
+      "\t\tif (end < data.size()) {\n"
+      "\t\t\tfailed_at = end;\n"
+      "\t\t}\n";
+  } else {
+    code +=
+      "\t\tif (lex_range(data, 0, data.size(), kinds, starts, lengths) < data.size()) {\n"
+      "\t\t\tthrow std::runtime_error(\"Unexpected token\");\n"
+      "\t\t}\n";
+  }
+  code +=
+    "\t}\n"
+    "\n"
+    "\tstd::vector<" + kind_t + "> kinds;\n"
+    "\tstd::vector<uint32_t> starts, lengths;\n";
+  return code;
+}
+
+/**
+ * All literals and regexes are compiled into the single DFA, the longest match wins.
+ * When several tokens have the same length, literals win over regexes and regexes are ordered by declaration.
+ * Transitions are indexed by character classes instead of raw bytes to keep the tables small.
+ * Without --spans the lexer may also read chunks from a source, keeping only the current token and a chunk in memory.
+ * States looping on a set of characters skip runs of such characters by SSE2/AVX2 kernels chosen at runtime,
+ * targets without SSE2 and PARSER_NO_SIMD defined when compiling the parser use the plain DFA walk.
+ * With --constexpr all members are constexpr, the kernels are used only when the lexer runs at runtime.
+ * With --pretokenize the same next()/undo() interface walks the array of tokens built by the constructor.
+ * With --incremental the array of tokens is also patched after edits of the input.
+ * With --push chunks are fed to the lexer, tokens completed by them are lexed ahead of the parser into the queue.
+ */
+std::string lexer_generator::generate() {
+  nfa lexer_nfa;
+  std::vector<std::string> token_types;
+  for (const auto &token: tokens) {
+    lexer_nfa.add_literal(token, token_types.size());
+    token_types.push_back(get_literal_type(token));
+  }
+  for (const auto&[regex_name, regex]: regexes) {
+    lexer_nfa.add_regex(regex, token_types.size());
+    token_types.push_back(regex_name);
+  }
+  std::vector<std::string> type_names = get_token_types();
+  dfa lexer_dfa(lexer_nfa);
+  run_kernels lexer_runs(lexer_dfa);
+
+  std::string code =
+    generate_token_types(regexes, tokens) +
+    generate_text_type(options) +
+    generate_mapped_file();
+  if (!lexer_runs.empty()) {
+    code +=
+      "#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && !defined(PARSER_NO_SIMD)\n"
+      "#define PARSER_SIMD\n"
+      "#include <immintrin.h>\n"
+      "#endif\n"
+      "\n";
+  }
+  std::string constexpr_ = options.constexpr_parser ? "constexpr " : "";
+  std::string input = options.spans ? "data" : "input()";
+  std::string tokenize = options.incremental ? "\t\ttokenize();\n\t\textend_reach(0, kinds.size());\n" : "\t\ttokenize();\n";
+  std::string ctor_body = options.pretokenize ? " {\n" + tokenize + "\t}\n" : " {}\n";
+  if (options.incremental) {
+    code +=
+      "// Tokens [begin, old_end) of the input before an edit are replaced by tokens [begin, new_end),\n"
+      "// the end of the input is the token after the last one\n"
+      "struct reparse_window {\n"
+      "\tsize_t begin = 0, old_end = 0, new_end = 0;\n"
+      "};\n"
+      "\n";
+  }
+  code +=
+    "class lexer {\n"
+    " public:\n";
+  if (options.spans) {
+    code +=
+      "\t" + constexpr_ + "lexer(std::string_view data)\n"
+      "\t\t: prev_pos(0)\n"
+      "\t\t, pos(0)\n"
+      "\t\t, data(data)" + ctor_body +
+      "\n"
+      "\tlexer(const mapped_file &file)\n"
+      "\t\t: lexer(file.view()) {}\n"
+      "\n";
+  } else if (options.push) {
+    code +=
+      "\tlexer() = default;\n"
+      "\n"
+      "\tlexer(std::string data)\n"
+      "\t\t: buffer(std::move(data))\n"
+      "\t\t, finished(true) {}\n"
+      "\n"
+      "\tlexer(const mapped_file &file)\n"
+      "\t\t: lexer(std::string(file.view())) {}\n"
+      "\n";
+  } else {
+    code +=
+      "\tusing source_t = std::function<size_t(char *, size_t)>;\n"
+      "\n"
+      "\tlexer(std::string data)\n"
+      "\t\t: prev_pos(0)\n"
+      "\t\t, pos(0)\n"
+      "\t\t, buffer(std::move(data))" + ctor_body +
+      "\n"
+      "\tlexer(const mapped_file &file)\n"
+      "\t\t: prev_pos(0)\n"
+      "\t\t, pos(0)\n"
+      "\t\t, mapped(file.view())" + ctor_body +
+      "\n"
+      "\tlexer(source_t source)\n"
+      "\t\t: prev_pos(0)\n"
+      "\t\t, pos(0)\n"
+      "\t\t, source(std::move(source))" +
+      (options.pretokenize ? " {\n\t\twhile (refill()) {}\n" + tokenize + "\t}\n" : " {}\n") +
+      "\n";
+  }
+  std::string position = "pos";
+  if (options.pretokenize) {
+    position = "pos < starts.size() ? starts[pos] : " + input + ".size()";
+  } else if (options.push) {
+    position = "pos < ahead.size() ? ahead[pos].start : consumed + scanned";
+  } else if (!options.spans) {
+    position = "consumed + pos";
+  }
+  code +=
+    "\t" + constexpr_ + "void undo() {\n"
+    "\t\tpos = prev_pos;\n"
     "\t}\n"
     "\n"
-    "\tstd::pair<TOKEN_TYPE, std::string> extract_token() {\n";
-  if (tokens.empty()) {
-    code += "\t\treturn {};\n";
+    "\t// Offset of the next token from the beginning of the input\n"
+    "\t" + constexpr_ + "size_t position() const {\n"
+    "\t\treturn " + position + ";\n"
+    "\t}\n"
+    "\n";
+  if (options.no_exceptions) {
+    code += generate_token_descriptions(type_names.size(), regexes, tokens);
+  }
+  code +=
+    "\t" + constexpr_ + "token_t next()" + (options.no_exceptions ? " noexcept" : "") + " {\n" +
+    std::string(options.push
+     ? "\t\tif (prev_pos != pos) {\n"
+       "\t\t\tahead.pop_front(); // The previous token can not be undone anymore\n"
+       "\t\t\tpos--;\n"
+       "\t\t}\n"
+     : "") +
+    "\t\tprev_pos = pos;\n";
+  if (options.push) {
+    code +=
+      "\t\tconst auto &token = ahead[pos];\n"
+      "\t\tif (token.type != TOKEN_TYPE::END) {\n"
+      "\t\t\tpos++;\n"
+      "\t\t}\n"
+      "\t\treturn {token.type, token.text};\n"
+      "\t}\n"
+      "\n"
+      "\t// Appends the chunk to the unfinished token, the text of lexed tokens is dropped\n"
+      "\tvoid feed(std::string_view chunk) {\n"
+      "\t\tconsumed += scanned;\n"
+      "\t\tbuffer.erase(0, scanned);\n"
+      "\t\tscanned = 0;\n"
+      "\t\tbuffer.append(chunk);\n"
+      "\t}\n"
+      "\n"
+      "\t// The last token does not wait for more characters after the end of the input\n"
+      "\tvoid finish() {\n"
+      "\t\tfinished = true;\n"
+      "\t}\n"
+      "\n"
+      "\t// Lexes until count tokens are ahead of the parser, false if the input fed so far is not enough for them\n"
+      "\tbool ready(size_t count) {\n"
+      "\t\twhile (ahead.size() - pos < count) {\n"
+      "\t\t\tif (!ahead.empty() && ahead.back().type == TOKEN_TYPE::END) {\n"
+      "\t\t\t\treturn true;\n"
+      "\t\t\t}\n"
+      "\t\t\tif (scanned == buffer.size()) {\n"
+      "\t\t\t\tif (!finished) {\n"
+      "\t\t\t\t\treturn false;\n"
+      "\t\t\t\t}\n"
+      "\t\t\t\tahead.push_back({TOKEN_TYPE::END, \"\", consumed + scanned});\n"
+      "\t\t\t\tcontinue;\n"
+      "\t\t\t}\n"
+      "\t\t\tTOKEN_TYPE type = TOKEN_TYPE::END;\n"
+      "\t\t\tbool at_end = false;\n"
+      "\t\t\tsize_t len = match(buffer.data() + scanned, buffer.data() + buffer.size(), type, at_end);\n"
+      "\t\t\tif (at_end && !finished) {\n"
+      "\t\t\t\treturn false; // The token may continue in the next chunk\n"
+      "\t\t\t}\n"
+      "\t\t\tif (len == 0) {\n"
+      "\t\t\t\tthrow std::runtime_error(\"Unexpected token\");\n"
+      "\t\t\t}\n"
+      "\t\t\tahead.push_back({type, buffer.substr(scanned, len), consumed + scanned});\n"
+      "\t\t\tscanned += len;\n"
+      "\t\t}\n"
+      "\t\treturn true;\n"
+      "\t}\n";
+  } else if (options.pretokenize) {
+    code +=
+      "\t\tif (pos == kinds.size()) {\n"
+      "\t\t\treturn {TOKEN_TYPE::END, \"\"};\n"
+      "\t\t}\n"
+      "\t\tpos++;\n"
+      "\t\treturn {static_cast<TOKEN_TYPE>(kinds[prev_pos]), text_t(" + input + ".substr(starts[prev_pos], lengths[prev_pos]))};\n"
+      "\t}\n"
+      "\n" +
+      generate_pretokenized_api(input);
+    if (options.incremental) {
+      code += generate_relex(state_type(type_names.size()));
+    }
+  } else if (options.spans) {
+    code +=
+      "\t\tif (pos == data.size()) {\n"
+      "\t\t\treturn {TOKEN_TYPE::END, \"\"};\n"
+      "\t\t}\n"
+      "\t\tTOKEN_TYPE type = TOKEN_TYPE::END;\n"
+      "\t\tbool at_end = false;\n"
+      "\t\tsize_t len = match(data.data() + pos, data.data() + data.size(), type, at_end);\n"
+      "\t\tif (len == 0) {\n" +
+      std::string(options.no_exceptions
+       ? "\t\t\tfailed_at = pos;\n"
+         "\t\t\treturn {TOKEN_TYPE::END, \"\"};\n"
+       : "\t\t\tthrow std::runtime_error(\"Unexpected token\");\n") +
+      "\t\t}\n"
+      "\t\tpos += len;\n"
+      "\t\treturn {type, text_t(data.substr(prev_pos, len))};\n"
+      "\t}\n";
   } else {
     code +=
-      "\t\tfor (size_t cur_pos = std::min(pos + " + std::to_string(max_token_len - 1) + ", data.size() - 1);; cur_pos--) {\n"
-      "\t\t\tstd::string cur_token = data.substr(pos, cur_pos - pos + 1);\n"
-      "\t\t\tif (tokens.count(cur_token)) {\n"
-      "\t\t\t\treturn {TOKEN_TYPE::TEXT, cur_token};\n"
+      "\t\twhile (true) {\n"
+      "\t\t\tstd::string_view data = input();\n"
+      "\t\t\tif (pos == data.size()) {\n"
+      "\t\t\t\tif (refill()) {\n"
+      "\t\t\t\t\tcontinue;\n"
+      "\t\t\t\t}\n"
+      "\t\t\t\treturn {TOKEN_TYPE::END, \"\"};\n"
       "\t\t\t}\n"
-      "\t\t\tif (cur_pos == pos) {\n"
-      "\t\t\t\treturn {};\n"
+      "\t\t\tTOKEN_TYPE type = TOKEN_TYPE::END;\n"
+      "\t\t\tbool at_end = false;\n"
+      "\t\t\tsize_t len = match(data.data() + pos, data.data() + data.size(), type, at_end);\n"
+      "\t\t\tif (at_end && refill()) {\n"
+      "\t\t\t\tcontinue; // The token may continue in the next chunk\n"
       "\t\t\t}\n"
-      "\t\t}\n";
+      "\t\t\tif (len == 0) {\n" +
+      std::string(options.no_exceptions
+       ? "\t\t\t\tfailed_at = consumed + pos;\n"
+         "\t\t\t\treturn {TOKEN_TYPE::END, \"\"};\n"
+       : "\t\t\t\tthrow std::runtime_error(\"Unexpected token\");\n") +
+      "\t\t\t}\n"
+      "\t\t\tpos += len;\n"
+      "\t\t\treturn {type, text_t(data.substr(prev_pos, len))};\n"
+      "\t\t}\n"
+      "\t}\n";
+  }
+  std::string skip_runs;
+  if (!lexer_runs.empty()) {
+    std::string runtime_only = options.constexpr_parser ? "!std::is_constant_evaluated() && " : "";
+    skip_runs =
+      "\t\t\tif (" + runtime_only + "state_runs[state] != 0) {\n"
+      "\t\t\t\tit = skip_run(state_runs[state], it + 1, end) - 1;\n"
+      "\t\t\t}\n";
   }
   code +=
+    "\n"
+    "\tstatic " + constexpr_ + "size_t match(const char *begin, const char *end, TOKEN_TYPE &type, bool &at_end) {\n"
+    "\t\tsize_t len = 0;\n"
+    "\t\tsize_t state = START_STATE;\n"
+    "\t\tfor (const char *it = begin; it != end; ++it) {\n"
+    "\t\t\tstate = transitions[state][char_classes[static_cast<unsigned char>(*it)]];\n"
+    "\t\t\tif (state == DEAD_STATE) {\n"
+    "\t\t\t\treturn len;\n"
+    "\t\t\t}\n" +
+    skip_runs +
+    "\t\t\tif (accepts[state] != TOKEN_TYPE::END) {\n"
+    "\t\t\t\ttype = accepts[state];\n"
+    "\t\t\t\tlen = it - begin + 1;\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\t\tat_end = true;\n"
+    "\t\treturn len;\n"
     "\t}\n"
     "\n"
-    "\tsize_t prev_pos, pos;\n"
-    "\tstd::string data;\n"
-    "\tstd::unordered_set<std::string> tokens;\n"
-    "\tstd::vector<std::pair<TOKEN_TYPE, std::regex>> regexes;\n"
-    "};\n\n";
+    " private:\n"
+    "\n" +
+    generate_dfa_tables(lexer_dfa, token_types);
+  if (!lexer_runs.empty()) {
+    code += lexer_runs.generate_table(state_type(lexer_runs.size() + 1)) + "\n" + lexer_runs.generate_functions();
+  }
+  code += "\n";
+  if (options.pretokenize) {
+    code += generate_tokenize(type_names, input, options);
+  }
+  if (options.incremental) {
+    code += generate_extend_reach() + "\n";
+  }
+  if (options.no_exceptions) {
+    code += "\tsize_t failed_at = std::numeric_limits<size_t>::max();\n";
+  }
+  if (options.spans) {
+    code +=
+      "\tsize_t prev_pos, pos;\n"
+      "\tstd::string_view data;\n"
+      "};\n\n";
+  } else if (options.push) {
+    code +=
+      "\tstruct lexed_token {\n"
+      "\t\tTOKEN_TYPE type;\n"
+      "\t\tstd::string text;\n"
+      "\t\tsize_t start;\n"
+      "\t};\n"
+      "\n"
+      "\t// Positions are indices in the queue, the token before pos is kept until the next token is taken\n"
+      "\tsize_t prev_pos = 0, pos = 0, scanned = 0, consumed = 0;\n"
+      "\tstd::string buffer;\n"
+      "\tbool finished = false;\n"
+      "\tstd::deque<lexed_token> ahead;\n"
+      "};\n\n";
+  } else {
+    code +=
+      "\tstatic constexpr size_t CHUNK_SIZE = 1 << 16;\n"
+      "\n"
+      "\tstd::string_view input() const {\n"
+      "\t\treturn mapped.data() != nullptr ? mapped : std::string_view(buffer);\n"
+      "\t}\n"
+      "\n"
+      "\tbool refill() {\n"
+      "\t\tif (!source) {\n"
+      "\t\t\treturn false;\n"
+      "\t\t}\n"
+      "\t\tconsumed += prev_pos;\n"
+      "\t\tbuffer.erase(0, prev_pos);\n"
+      "\t\tpos -= prev_pos;\n"
+      "\t\tprev_pos = 0;\n"
+      "\t\tsize_t size = buffer.size();\n"
+      "\t\tbuffer.resize(size + CHUNK_SIZE);\n"
+      "\t\tsize_t read = source(&buffer[size], CHUNK_SIZE);\n"
+      "\t\tbuffer.resize(size + read);\n"
+      "\t\tif (read == 0) {\n"
+      "\t\t\tsource = nullptr;\n"
+      "\t\t}\n"
+      "\t\treturn read != 0;\n"
+      "\t}\n"
+      "\n"
+      "\tsize_t prev_pos, pos, consumed = 0;\n"
+      "\tstd::string buffer;\n"
+      "\tstd::string_view mapped;\n"
+      "\tsource_t source;\n"
+      "};\n\n";
+  }
   return code;
 }
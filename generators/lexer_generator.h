@@ -6,22 +6,26 @@
 #define PARSER_GENERATOR_GENERATORS_LEXER_GENERATOR_H_
 
 #include <string>
-#include <unordered_set>
-#include <unordered_map>
-#include <regex>
+#include <set>
+#include <vector>
+#include <utility>
+#include "generator_options.h"
 
 class lexer_generator {
  public:
-  lexer_generator() = default;
+  explicit lexer_generator(const generator_options &options);
 
   void add_token(const std::string& token_text);
   void add_regex(const std::string& regex_name, const std::string& regex);
 
+  std::string get_literal_type(const std::string &literal) const;
+  std::vector<std::string> get_token_types() const;
   std::string generate();
 
  private:
-  std::unordered_set<std::string> tokens;
-  std::unordered_map<std::string, std::string> regexes;
+  generator_options options;
+  std::set<std::string> tokens;
+  std::vector<std::pair<std::string, std::string>> regexes;
 };
 
 #endif //PARSER_GENERATOR_GENERATORS_LEXER_GENERATOR_H_
@@ -0,0 +1,409 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "nfa.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+static const size_t UNBOUNDED = static_cast<size_t>(-1);
+
+enum class REGEX_KIND {
+  EMPTY,
+  CHARSET,
+  CONCAT,
+  ALTERNATION,
+  REPEAT
+};
+
+struct regex_ast {
+  REGEX_KIND kind = REGEX_KIND::EMPTY;
+  nfa::charset chars;
+  std::vector<regex_ast> children;
+  size_t min = 0, max = 0;
+};
+
+static nfa::charset char_range(unsigned char from, unsigned char to) {
+  nfa::charset res;
+  for (size_t c = from; c <= to; c++) {
+    res.set(c);
+  }
+  return res;
+}
+
+static nfa::charset single_char(char c) {
+  nfa::charset res;
+  res.set(static_cast<unsigned char>(c));
+  return res;
+}
+
+/**
+ * Parses ECMAScript regular expressions (the dialect used by std::regex) into the syntax tree.
+ * Assertions and backreferences can not be expressed by finite automaton, so they are rejected.
+ */
+class regex_ast_parser {
+ public:
+  explicit regex_ast_parser(const std::string &regex)
+    : regex(regex)
+    , pos(0) {}
+
+  regex_ast parse() {
+    regex_ast res = parse_alternation();
+    if (pos != regex.size()) {
+      error("unbalanced ')'");
+    }
+    return res;
+  }
+
+ private:
+  const std::string &regex;
+  size_t pos;
+
+  [[noreturn]] void error(const std::string &message) const {
+    throw std::runtime_error("Can not compile regex '" + regex + "': " + message);
+  }
+
+  bool eof() const {
+    return pos == regex.size();
+  }
+
+  regex_ast parse_alternation() {
+    regex_ast first = parse_concat();
+    if (eof() || regex[pos] != '|') {
+      return first;
+    }
+    regex_ast res;
+    res.kind = REGEX_KIND::ALTERNATION;
+    res.children.push_back(std::move(first));
+    while (!eof() && regex[pos] == '|') {
+      pos++;
+      res.children.push_back(parse_concat());
+    }
+    return res;
+  }
+
+  regex_ast parse_concat() {
+    regex_ast res;
+    res.kind = REGEX_KIND::CONCAT;
+    while (!eof() && regex[pos] != '|' && regex[pos] != ')') {
+      res.children.push_back(parse_repeat());
+    }
+    return res;
+  }
+
+  static bool is_quantifier(char c) {
+    return c == '*' || c == '+' || c == '?' || c == '{';
+  }
+
+  regex_ast parse_repeat() {
+    regex_ast atom = parse_atom();
+    if (eof() || !is_quantifier(regex[pos])) {
+      return atom;
+    }
+
+    regex_ast res;
+    res.kind = REGEX_KIND::REPEAT;
+    if (regex[pos] == '*') {
+      res.min = 0;
+      res.max = UNBOUNDED;
+      pos++;
+    } else if (regex[pos] == '+') {
+      res.min = 1;
+      res.max = UNBOUNDED;
+      pos++;
+    } else if (regex[pos] == '?') {
+      res.min = 0;
+      res.max = 1;
+      pos++;
+    } else {
+      parse_bounds(res.min, res.max);
+    }
+    if (!eof() && regex[pos] == '?') {
+      pos++; // Lazy quantifier, it does not change the longest match
+    }
+    if (!eof() && is_quantifier(regex[pos])) {
+      error("nothing to repeat");
+    }
+    res.children.push_back(std::move(atom));
+    return res;
+  }
+
+  size_t parse_number() {
+    if (eof() || !std::isdigit(regex[pos])) {
+      error("number expected in braces");
+    }
+    size_t res = 0;
+    for (; !eof() && std::isdigit(regex[pos]); pos++) {
+      res = res * 10 + (regex[pos] - '0');
+    }
+    return res;
+  }
+
+  void parse_bounds(size_t &min, size_t &max) {
+    pos++; // Skip '{'
+    min = max = parse_number();
+    if (!eof() && regex[pos] == ',') {
+      pos++;
+      max = !eof() && regex[pos] == '}' ? UNBOUNDED : parse_number();
+    }
+    if (eof() || regex[pos] != '}') {
+      error("'}' expected");
+    }
+    pos++;
+    if (min > max) {
+      error("invalid range in braces");
+    }
+  }
+
+  regex_ast parse_atom() {
+    regex_ast res;
+    res.kind = REGEX_KIND::CHARSET;
+    char c = regex[pos];
+    if (c == '(') {
+      pos++;
+      if (regex.compare(pos, 2, "?:") == 0) {
+        pos += 2;
+      } else if (!eof() && regex[pos] == '?') {
+        error("assertions are not supported");
+      }
+      res = parse_alternation();
+      if (eof() || regex[pos] != ')') {
+        error("')' expected");
+      }
+      pos++;
+    } else if (c == '[') {
+      res.chars = parse_class();
+    } else if (c == '.') {
+      res.chars.set();
+      res.chars.reset('\n');
+      res.chars.reset('\r');
+      pos++;
+    } else if (c == '^' || c == '$') {
+      error("anchors are not supported");
+    } else if (c == '\\') {
+      res.chars = parse_escape(false);
+    } else if (is_quantifier(c)) {
+      error("nothing to repeat");
+    } else {
+      res.chars = single_char(c);
+      pos++;
+    }
+    return res;
+  }
+
+  unsigned char parse_hex(size_t digits) {
+    size_t res = 0;
+    for (size_t i = 0; i < digits; i++, pos++) {
+      if (eof() || !std::isxdigit(regex[pos])) {
+        error("hexadecimal digit expected");
+      }
+      char c = static_cast<char>(std::tolower(regex[pos]));
+      res = res * 16 + (std::isdigit(c) ? c - '0' : c - 'a' + 10);
+    }
+    if (res > 0xFF) {
+      error("only single byte characters are supported");
+    }
+    return static_cast<unsigned char>(res);
+  }
+
+  nfa::charset parse_escape(bool in_class) {
+    pos++; // Skip '\'
+    if (eof()) {
+      error("trailing backslash");
+    }
+    char c = regex[pos++];
+    nfa::charset digits = char_range('0', '9');
+    nfa::charset word = digits | char_range('a', 'z') | char_range('A', 'Z') | single_char('_');
+    nfa::charset space = char_range('\t', '\r') | single_char(' ');
+    switch (c) {
+      case 'd':
+        return digits;
+      case 'D':
+        return ~digits;
+      case 'w':
+        return word;
+      case 'W':
+        return ~word;
+      case 's':
+        return space;
+      case 'S':
+        return ~space;
+      case 'n':
+        return single_char('\n');
+      case 'r':
+        return single_char('\r');
+      case 't':
+        return single_char('\t');
+      case 'f':
+        return single_char('\f');
+      case 'v':
+        return single_char('\v');
+      case '0':
+        return single_char('\0');
+      case 'x':
+        return single_char(static_cast<char>(parse_hex(2)));
+      case 'u':
+        return single_char(static_cast<char>(parse_hex(4)));
+      case 'c':
+        if (eof() || !std::isalpha(regex[pos])) {
+          error("control letter expected after \\c");
+        }
+        return single_char(static_cast<char>(regex[pos++] % 32));
+      case 'b':
+        if (in_class) {
+          return single_char('\b');
+        }
+        error("word boundaries are not supported");
+      default:
+        if (std::isdigit(c)) {
+          error("backreferences are not supported");
+        }
+        if (std::isalpha(c)) {
+          error(std::string("unknown escape \\") + c);
+        }
+        return single_char(c);
+    }
+  }
+
+  nfa::charset parse_class_atom() {
+    if (regex[pos] == '\\') {
+      return parse_escape(true);
+    }
+    return single_char(regex[pos++]);
+  }
+
+  static unsigned char only_char(const nfa::charset &chars) {
+    for (size_t c = 0; c < chars.size(); c++) {
+      if (chars.test(c)) {
+        return static_cast<unsigned char>(c);
+      }
+    }
+    return 0;
+  }
+
+  nfa::charset parse_class() {
+    pos++; // Skip '['
+    bool negate = !eof() && regex[pos] == '^';
+    if (negate) {
+      pos++;
+    }
+    nfa::charset res;
+    while (!eof() && regex[pos] != ']') {
+      nfa::charset from = parse_class_atom();
+      if (from.count() == 1 && pos + 1 < regex.size() && regex[pos] == '-' && regex[pos + 1] != ']') {
+        pos++; // Skip '-'
+        nfa::charset to = parse_class_atom();
+        if (to.count() != 1 || only_char(from) > only_char(to)) {
+          error("invalid range in character class");
+        }
+        res |= char_range(only_char(from), only_char(to));
+      } else {
+        res |= from;
+      }
+    }
+    if (eof()) {
+      error("']' expected");
+    }
+    pos++;
+    return negate ? ~res : res;
+  }
+};
+
+nfa::nfa()
+  : states(2)
+  , literals_root(1) {
+  states[get_start()].eps_transitions.push_back(literals_root);
+}
+
+size_t nfa::add_state() {
+  states.emplace_back();
+  return states.size() - 1;
+}
+
+/**
+ * Builds Thompson's automaton for regex syntax tree, returns its start and final states
+ */
+std::pair<size_t, size_t> nfa::add_ast(const regex_ast &ast) {
+  size_t start = add_state(), end = start;
+  switch (ast.kind) {
+    case REGEX_KIND::EMPTY:
+      break;
+    case REGEX_KIND::CHARSET:
+      end = add_state();
+      states[start].transitions.emplace_back(ast.chars, end);
+      break;
+    case REGEX_KIND::CONCAT:
+      for (const auto &child: ast.children) {
+        auto[child_start, child_end] = add_ast(child);
+        states[end].eps_transitions.push_back(child_start);
+        end = child_end;
+      }
+      break;
+    case REGEX_KIND::ALTERNATION:
+      end = add_state();
+      for (const auto &child: ast.children) {
+        auto[child_start, child_end] = add_ast(child);
+        states[start].eps_transitions.push_back(child_start);
+        states[child_end].eps_transitions.push_back(end);
+      }
+      break;
+    case REGEX_KIND::REPEAT:
+      for (size_t i = 0; i < ast.min; i++) {
+        auto[child_start, child_end] = add_ast(ast.children[0]);
+        states[end].eps_transitions.push_back(child_start);
+        end = child_end;
+      }
+      if (ast.max == UNBOUNDED) {
+        size_t loop = add_state();
+        auto[child_start, child_end] = add_ast(ast.children[0]);
+        states[end].eps_transitions.push_back(loop);
+        states[loop].eps_transitions.push_back(child_start);
+        states[child_end].eps_transitions.push_back(loop);
+        end = loop;
+      } else {
+        for (size_t i = ast.min; i < ast.max; i++) {
+          size_t skip = add_state();
+          auto[child_start, child_end] = add_ast(ast.children[0]);
+          states[end].eps_transitions.push_back(child_start);
+          states[end].eps_transitions.push_back(skip);
+          states[child_end].eps_transitions.push_back(skip);
+          end = skip;
+        }
+      }
+      break;
+  }
+  return {start, end};
+}
+
+/**
+ * Literals share the prefix tree, so the automaton has a single path for all literals with the same prefix
+ */
+void nfa::add_literal(const std::string &literal, size_t token) {
+  size_t cur = literals_root;
+  for (char c: literal) {
+    auto it = literals_trie.find({cur, c});
+    if (it == literals_trie.end()) {
+      size_t next = add_state();
+      states[cur].transitions.emplace_back(single_char(c), next);
+      it = literals_trie.emplace(std::make_pair(cur, c), next).first;
+    }
+    cur = it->second;
+  }
+  states[cur].token = std::min(states[cur].token, token);
+}
+
+void nfa::add_regex(const std::string &regex, size_t token) {
+  regex_ast ast = regex_ast_parser(regex).parse();
+  auto[start, end] = add_ast(ast);
+  states[get_start()].eps_transitions.push_back(start);
+  states[end].token = token;
+}
+
+size_t nfa::get_start() const {
+  return 0;
+}
+
+const std::vector<nfa::state> &nfa::get_states() const {
+  return states;
+}
@@ -0,0 +1,48 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_GENERATORS_NFA_H_
+#define PARSER_GENERATOR_GENERATORS_NFA_H_
+
+#include <bitset>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct regex_ast;
+
+/**
+ * Nondeterministic automaton accepting all lexer tokens, each final state is marked with token id
+ */
+class nfa {
+ public:
+  using charset = std::bitset<256>;
+
+  static constexpr size_t NO_TOKEN = static_cast<size_t>(-1);
+
+  struct state {
+    std::vector<std::pair<charset, size_t>> transitions;
+    std::vector<size_t> eps_transitions;
+    size_t token = NO_TOKEN;
+  };
+
+  nfa();
+
+  void add_literal(const std::string &literal, size_t token);
+  void add_regex(const std::string &regex, size_t token);
+
+  size_t get_start() const;
+  const std::vector<state> &get_states() const;
+
+ private:
+  std::vector<state> states;
+  size_t literals_root;
+  std::map<std::pair<size_t, char>, size_t> literals_trie;
+
+  size_t add_state();
+  std::pair<size_t, size_t> add_ast(const regex_ast &ast);
+};
+
+#endif //PARSER_GENERATOR_GENERATORS_NFA_H_
@@ -0,0 +1,333 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "profile_generator.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+profile_generator::profile_generator(const generator_options &options,
+                                     const std::unordered_map<std::string, rule> &rules)
+  : options(options) {
+  std::vector<std::string> rule_names;
+  for (const auto &rule_entry: rules) {
+    rule_names.push_back(rule_entry.first);
+  }
+  std::sort(rule_names.begin(), rule_names.end());
+  for (const auto &rule_name: rule_names) {
+    entries.emplace_back(rule_entry(rule_name), rule_name);
+    alternatives.emplace_back(rule_name, rules.at(rule_name).get_alternatives_count());
+  }
+  for (const auto &rule_name: rule_names) {
+    std::vector<std::string> fun_names = rules.at(rule_name).get_fun_names();
+    std::sort(fun_names.begin(), fun_names.end());
+    for (const auto &fun_name: fun_names) {
+      entries.emplace_back(fun_entry(rule_name, fun_name), rule_name + " $" + fun_name);
+    }
+  }
+}
+
+std::string profile_generator::rule_entry(const std::string &rule_name) {
+  return "RULE_" + rule_name;
+}
+
+std::string profile_generator::fun_entry(const std::string &rule_name, const std::string &fun_name) {
+  return "FUN_" + rule_name + "_" + fun_name;
+}
+
+std::string profile_generator::generate_scope(const std::string &entry, const std::string &indent) {
+  return indent + "profile_scope profile_scope_(PROFILE_ENTRY::" + entry + ");\n";
+}
+
+std::string profile_generator::generate_alternative_counter(const std::string &rule_name, size_t alternative) {
+  return
+    "\tprofile_.alternatives[static_cast<size_t>(PROFILE_ALTERNATIVE::" + rule_name + ") + " +
+    std::to_string(alternative) + "]++;\n";
+}
+
+/**
+ * Lines of the profile are "rule alternative count", counts of the same alternative from several runs are summed
+ */
+std::unordered_map<std::string, std::vector<uint64_t>> profile_generator::read_frequencies(const std::string &path) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    throw std::runtime_error("Profile " + path + " can not be opened.");
+  }
+  std::unordered_map<std::string, std::vector<uint64_t>> frequencies;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream line_in(line);
+    std::string rule_name;
+    size_t alternative;
+    uint64_t count;
+    if (!(line_in >> rule_name)) {
+      continue;
+    }
+    if (!(line_in >> alternative >> count)) {
+      throw std::runtime_error("Wrong line in profile " + path + ":\n" + line);
+    }
+    auto &rule_frequencies = frequencies[rule_name];
+    if (rule_frequencies.size() <= alternative) {
+      rule_frequencies.resize(alternative + 1);
+    }
+    rule_frequencies[alternative] += count;
+  }
+  return frequencies;
+}
+
+/**
+ * Replaced global allocation functions of the program, on_allocate is run for every allocation of size bytes.
+ * All the forms of operator new and operator delete are replaced together and use the same malloc and free,
+ * deallocation is not inlined, so GCC does not take free of a pointer from operator new as a mismatch.
+ */
+std::string profile_generator::generate_allocation_hooks(const std::string &on_allocate) {
+  std::string code =
+    "static void *hooked_allocate(size_t size, size_t alignment) noexcept {\n" +
+    on_allocate +
+    "\tsize = std::max<size_t>(size, 1);\n"
+    "\tif (alignment <= alignof(std::max_align_t)) {\n"
+    "\t\treturn std::malloc(size);\n"
+    "\t}\n"
+    "\t// Memory resources of the arena allocate with the alignment\n"
+    "\talignment = std::max(alignment, sizeof(void *));\n"
+    "\treturn std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);\n"
+    "}\n"
+    "\n"
+    "static void *hooked_allocate_or_throw(size_t size, size_t alignment) {\n"
+    "\tif (void *ptr = hooked_allocate(size, alignment)) {\n"
+    "\t\treturn ptr;\n"
+    "\t}\n"
+    "\tthrow std::bad_alloc();\n"
+    "}\n"
+    "\n"
+    "__attribute__((noinline)) static void hooked_deallocate(void *ptr) noexcept {\n"
+    "\tstd::free(ptr);\n"
+    "}\n"
+    "\n";
+  for (const std::string array: {"", "[]"}) {
+    code +=
+      "void *operator new" + array + "(size_t size) {\n"
+      "\treturn hooked_allocate_or_throw(size, alignof(std::max_align_t));\n"
+      "}\n"
+      "\n"
+      "void *operator new" + array + "(size_t size, std::align_val_t alignment) {\n"
+      "\treturn hooked_allocate_or_throw(size, static_cast<size_t>(alignment));\n"
+      "}\n"
+      "\n"
+      "void *operator new" + array + "(size_t size, const std::nothrow_t &) noexcept {\n"
+      "\treturn hooked_allocate(size, alignof(std::max_align_t));\n"
+      "}\n"
+      "\n"
+      "void *operator new" + array + "(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {\n"
+      "\treturn hooked_allocate(size, static_cast<size_t>(alignment));\n"
+      "}\n"
+      "\n";
+    for (const std::string params: {"", ", size_t", ", std::align_val_t", ", size_t, std::align_val_t",
+                                    ", const std::nothrow_t &", ", std::align_val_t, const std::nothrow_t &"}) {
+      code +=
+        "void operator delete" + array + "(void *ptr" + params + ") noexcept {\n"
+        "\thooked_deallocate(ptr);\n"
+        "}\n"
+        "\n";
+    }
+  }
+  return code;
+}
+
+/**
+ * The scope adds its time, tokens and bytes to its entry without the ones of nested scopes, and all of them to the
+ * parent scope. Time of recursive calls is added to the inclusive time only by the outermost call of the entry.
+ */
+std::string profile_generator::generate_declaration() const {
+  std::string code =
+    "#if defined(__x86_64__) || defined(__i386__)\n"
+    "#include <x86intrin.h>\n"
+    "#define PROFILE_UNIT \"TSC ticks\"\n"
+    "#else\n"
+    "#define PROFILE_UNIT \"ns\"\n"
+    "#endif\n"
+    "\n"
+    "enum class PROFILE_ENTRY {\n";
+  for (const auto &entry: entries) {
+    code += "\t" + entry.first + ",\n";
+  }
+  code +=
+    "\tCOUNT\n"
+    "};\n"
+    "\n"
+    "// Index of the first alternative of the rule in the counters of alternatives\n"
+    "enum class PROFILE_ALTERNATIVE {\n";
+  size_t offset = 0;
+  for (const auto&[rule_name, count]: alternatives) {
+    code += "\t" + rule_name + " = " + std::to_string(offset) + ",\n";
+    offset += count;
+  }
+  code +=
+    "\tCOUNT = " + std::to_string(offset) + "\n"
+    "};\n"
+    "\n"
+    "struct profile_counter {\n"
+    "\tuint64_t calls = 0, inclusive = 0, exclusive = 0, tokens = 0, bytes = 0;\n"
+    "\tsize_t active = 0;\n"
+    "};\n"
+    "\n"
+    "// Counters of the current thread, tokens and bytes are totals the scopes take differences of\n"
+    "struct profile_state {\n"
+    "\tprofile_counter counters[static_cast<size_t>(PROFILE_ENTRY::COUNT)];\n"
+    "\tuint64_t alternatives[static_cast<size_t>(PROFILE_ALTERNATIVE::COUNT)] = {};\n"
+    "\tuint64_t tokens = 0, bytes = 0;\n"
+    "\tclass profile_scope *current = nullptr;\n"
+    "};\n"
+    "\n"
+    "inline thread_local profile_state profile_;\n"
+    "\n"
+    "inline uint64_t profile_clock() {\n"
+    "#if defined(__x86_64__) || defined(__i386__)\n"
+    "\treturn __rdtsc();\n"
+    "#else\n"
+    "\treturn std::chrono::duration_cast<std::chrono::nanoseconds>(\n"
+    "\t\tstd::chrono::steady_clock::now().time_since_epoch()).count();\n"
+    "#endif\n"
+    "}\n"
+    "\n"
+    "class profile_scope {\n"
+    " public:\n"
+    "\texplicit profile_scope(PROFILE_ENTRY entry)\n"
+    "\t\t: counter(profile_.counters[static_cast<size_t>(entry)])\n"
+    "\t\t, parent(profile_.current)\n"
+    "\t\t, start_tokens(profile_.tokens)\n"
+    "\t\t, start_bytes(profile_.bytes) {\n"
+    "\t\tprofile_.current = this;\n"
+    "\t\tcounter.active++;\n"
+    "\t\tstart = profile_clock();\n"
+    "\t}\n"
+    "\n"
+    "\tprofile_scope(const profile_scope &) = delete;\n"
+    "\tprofile_scope &operator=(const profile_scope &) = delete;\n"
+    "\n"
+    "\t~profile_scope() {\n"
+    "\t\tuint64_t ticks = profile_clock() - start;\n"
+    "\t\tuint64_t tokens = profile_.tokens - start_tokens, bytes = profile_.bytes - start_bytes;\n"
+    "\t\tcounter.calls++;\n"
+    "\t\tif (--counter.active == 0) {\n"
+    "\t\t\tcounter.inclusive += ticks;\n"
+    "\t\t}\n"
+    "\t\tcounter.exclusive += ticks - child_ticks;\n"
+    "\t\tcounter.tokens += tokens - child_tokens;\n"
+    "\t\tcounter.bytes += bytes - child_bytes;\n"
+    "\t\tif (parent != nullptr) {\n"
+    "\t\t\tparent->child_ticks += ticks;\n"
+    "\t\t\tparent->child_tokens += tokens;\n"
+    "\t\t\tparent->child_bytes += bytes;\n"
+    "\t\t}\n"
+    "\t\tprofile_.current = parent;\n"
+    "\t}\n"
+    "\n"
+    " private:\n"
+    "\tprofile_counter &counter;\n"
+    "\tprofile_scope *parent;\n"
+    "\tuint64_t start = 0, start_tokens, start_bytes;\n"
+    "\tuint64_t child_ticks = 0, child_tokens = 0, child_bytes = 0;\n"
+    "};\n"
+    "\n"
+    "// Prints counters of the current thread sorted by exclusive time\n"
+    "void profile_report(std::ostream &out);\n"
+    "// Clears counters of the current thread, must not be called while parsing\n"
+    "void profile_reset();\n"
+    "// Appends numbers of calls of the alternatives to the profile read by the generator with --pgo\n"
+    "void profile_save(const std::string &path);\n"
+    "\n";
+  return code;
+}
+
+std::string profile_generator::generate_implementation() const {
+  size_t width = 5;
+  std::string names, rules;
+  for (const auto &entry: entries) {
+    width = std::max(width, entry.second.size());
+    names += "\t\"" + entry.second + "\",\n";
+  }
+  for (const auto&[rule_name, count]: alternatives) {
+    rules += "\t{\"" + rule_name + "\", " + std::to_string(count) + "},\n";
+  }
+  std::string name_width = std::to_string(width + 2);
+  std::string code =
+    "static const char *const profile_names[] = {\n" +
+    names +
+    "};\n"
+    "\n"
+    "void profile_report(std::ostream &out) {\n"
+    "\tconst auto &counters = profile_.counters;\n"
+    "\tstd::vector<size_t> order;\n"
+    "\tuint64_t total = 0;\n"
+    "\tfor (size_t i = 0; i < std::size(counters); i++) {\n"
+    "\t\tif (counters[i].calls != 0) {\n"
+    "\t\t\torder.push_back(i);\n"
+    "\t\t\ttotal += counters[i].exclusive;\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\tstd::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {\n"
+    "\t\treturn counters[a].exclusive > counters[b].exclusive;\n"
+    "\t});\n"
+    "\n"
+    "\tstd::ostringstream report;\n"
+    "\treport << \"Time in \" PROFILE_UNIT \", inclusive time of recursive calls is counted by the outermost one\\n\"\n"
+    "\t\t<< std::left << std::setw(" + name_width + ") << \"entry\" << std::right\n"
+    "\t\t<< std::setw(12) << \"calls\" << std::setw(16) << \"inclusive\" << std::setw(16) << \"exclusive\"\n"
+    "\t\t<< std::setw(8) << \"%\" << std::setw(12) << \"tokens\" << std::setw(14) << \"bytes\" << '\\n';\n"
+    "\tfor (size_t i: order) {\n"
+    "\t\tconst profile_counter &counter = counters[i];\n"
+    "\t\treport << std::left << std::setw(" + name_width + ") << profile_names[i] << std::right\n"
+    "\t\t\t<< std::setw(12) << counter.calls << std::setw(16) << counter.inclusive << std::setw(16) << counter.exclusive\n"
+    "\t\t\t<< std::setw(8) << std::fixed << std::setprecision(2) << 100.0 * counter.exclusive / std::max<uint64_t>(total, 1)\n"
+    "\t\t\t<< std::setw(12) << counter.tokens << std::setw(14) << counter.bytes << '\\n';\n"
+    "\t}\n"
+    "\tout << report.str();\n"
+    "}\n"
+    "\n"
+    "void profile_reset() {\n"
+    "\tfor (auto &counter: profile_.counters) {\n"
+    "\t\tcounter = {};\n"
+    "\t}\n"
+    "\tstd::fill(std::begin(profile_.alternatives), std::end(profile_.alternatives), 0);\n"
+    "}\n"
+    "\n"
+    "static const std::pair<const char *, size_t> profile_rules[] = {\n" +
+    rules +
+    "};\n"
+    "\n"
+    "void profile_save(const std::string &path) {\n"
+    "\tstd::ofstream out(path, std::ios::app);\n"
+    "\tsize_t offset = 0;\n"
+    "\tfor (const auto&[rule_name, count]: profile_rules) {\n"
+    "\t\tfor (size_t i = 0; i < count; i++) {\n"
+    "\t\t\tif (profile_.alternatives[offset + i] != 0) {\n"
+    "\t\t\t\tout << rule_name << ' ' << i << ' ' << profile_.alternatives[offset + i] << '\\n';\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\t\toffset += count;\n"
+    "\t}\n"
+    "\tif (!out) {\n"
+    "\t\tthrow std::runtime_error(\"Profile \" + path + \" can not be written\");\n"
+    "\t}\n"
+    "}\n"
+    "\n";
+  // With --bench the driver replaces operator new itself and adds the bytes too
+  if (!options.bench) {
+    code += generate_allocation_hooks("\tprofile_.bytes += size;\n");
+  }
+  return code;
+}
+
+/**
+ * The report is printed after every run, the profile for --pgo is saved when PARSER_PROFILE names its file
+ */
+std::string profile_generator::generate_main_epilogue() {
+  return
+    "\tprofile_report(std::cerr);\n"
+    "\tif (const char *path = std::getenv(\"PARSER_PROFILE\")) {\n"
+    "\t\tprofile_save(path);\n"
+    "\t}\n";
+}
@@ -0,0 +1,44 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_GENERATORS_PROFILE_GENERATOR_H_
+#define PARSER_GENERATOR_GENERATORS_PROFILE_GENERATOR_H_
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "generator_options.h"
+#include "../parser/rule.h"
+
+/**
+ * Generates the instrumentation of rules and actions (--profile): thread-local counters of calls, inclusive and
+ * exclusive time, tokens and allocated bytes, updated by scopes opened at the beginning of parse functions
+ * and actions, and profile_report printing them sorted by exclusive time.
+ * Numbers of calls of every alternative are saved by profile_save and read back by the generator with --pgo.
+ */
+class profile_generator {
+ public:
+  profile_generator(const generator_options &options, const std::unordered_map<std::string, rule> &rules);
+
+  std::string generate_declaration() const;
+  std::string generate_implementation() const;
+
+  static std::string rule_entry(const std::string &rule_name);
+  static std::string fun_entry(const std::string &rule_name, const std::string &fun_name);
+  static std::string generate_scope(const std::string &entry, const std::string &indent);
+  static std::string generate_alternative_counter(const std::string &rule_name, size_t alternative);
+  static std::string generate_main_epilogue();
+  static std::string generate_allocation_hooks(const std::string &on_allocate);
+  static std::unordered_map<std::string, std::vector<uint64_t>> read_frequencies(const std::string &path);
+
+ private:
+  generator_options options;
+  // Enumerator of every entry and its name in the report
+  std::vector<std::pair<std::string, std::string>> entries;
+  // Rules with the numbers of their alternatives
+  std::vector<std::pair<std::string, size_t>> alternatives;
+};
+
+#endif //PARSER_GENERATOR_GENERATORS_PROFILE_GENERATOR_H_
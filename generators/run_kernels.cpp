@@ -0,0 +1,167 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "run_kernels.h"
+#include <algorithm>
+
+static std::vector<std::pair<unsigned char, unsigned char>> to_ranges(const nfa::charset &chars) {
+  std::vector<std::pair<unsigned char, unsigned char>> ranges;
+  for (size_t c = 0; c < chars.size(); c++) {
+    if (!chars.test(c)) {
+      continue;
+    }
+    if (!ranges.empty() && ranges.back().second + 1u == c) {
+      ranges.back().second = static_cast<unsigned char>(c);
+    } else {
+      ranges.emplace_back(static_cast<unsigned char>(c), static_cast<unsigned char>(c));
+    }
+  }
+  return ranges;
+}
+
+bool run_kernels::kernel::operator==(const kernel &other) const {
+  return ranges == other.ranges && negated == other.negated;
+}
+
+run_kernels::run_kernels(const dfa &lexer_dfa)
+  : state_kernels(lexer_dfa.size(), 0) {
+  for (size_t state = dfa::START; state < lexer_dfa.size(); state++) {
+    nfa::charset loop;
+    for (size_t c = 0; c < loop.size(); c++) {
+      if (lexer_dfa.next(state, static_cast<unsigned char>(c)) == state) {
+        loop.set(c);
+      }
+    }
+    if (loop.none()) {
+      continue;
+    }
+
+    kernel cur_kernel{to_ranges(loop), false};
+    if (cur_kernel.ranges.size() > MAX_RANGES) {
+      cur_kernel = {to_ranges(~loop), true};
+      if (cur_kernel.ranges.size() > MAX_RANGES) {
+        continue;
+      }
+    }
+    auto it = std::find(kernels.begin(), kernels.end(), cur_kernel);
+    if (it == kernels.end()) {
+      it = kernels.insert(kernels.end(), cur_kernel);
+    }
+    state_kernels[state] = static_cast<size_t>(it - kernels.begin()) + 1;
+  }
+}
+
+bool run_kernels::empty() const {
+  return kernels.empty();
+}
+
+size_t run_kernels::size() const {
+  return kernels.size();
+}
+
+std::string run_kernels::generate_table(const std::string &type) const {
+  std::string code = "\tstatic constexpr " + type + " state_runs[" + std::to_string(state_kernels.size()) + "] = {";
+  for (size_t state = 0; state < state_kernels.size(); state++) {
+    code += (state == 0 ? "" : ", ") + std::to_string(state_kernels[state]);
+  }
+  code += "};\n";
+  return code;
+}
+
+static std::string char_literal(unsigned char c) {
+  return "static_cast<char>(" + std::to_string(c) + ")";
+}
+
+/**
+ * Kernel returns the first character not belonging to the run, or the tail shorter than the vector width
+ */
+std::string run_kernels::generate_kernel(const kernel &cur_kernel, size_t id, size_t width) {
+  bool avx2 = width == 32;
+  std::string vector_t = avx2 ? "__m256i" : "__m128i";
+  std::string prefix = avx2 ? "_mm256_" : "_mm_";
+  std::string suffix = avx2 ? "_avx2" : "_sse2";
+
+  std::string found;
+  for (const auto&[from, to]: cur_kernel.ranges) {
+    std::string in_range = from == to
+      ? prefix + "cmpeq_epi8(chunk, " + prefix + "set1_epi8(" + char_literal(from) + "))"
+      : "in_range(chunk, " + char_literal(from) + ", " + char_literal(static_cast<unsigned char>(to - from)) + ")";
+    found = found.empty() ? in_range : prefix + (avx2 ? "or_si256(" : "or_si128(") + found + ", " + in_range + ")";
+  }
+  std::string mask = "static_cast<unsigned>(" + prefix + "movemask_epi8(found))";
+  if (!cur_kernel.negated) {
+    mask = avx2 ? "~" + mask : "~" + mask + " & 0xFFFFu";
+  }
+
+  return
+    std::string(avx2 ? "\t__attribute__((target(\"avx2\")))\n" : "") +
+    "\tstatic const char *skip_run_" + std::to_string(id) + suffix + "(const char *it, const char *end) {\n"
+    "\t\tfor (; end - it >= " + std::to_string(width) + "; it += " + std::to_string(width) + ") {\n"
+    "\t\t\t" + vector_t + " chunk = " + prefix + "loadu_si" + std::to_string(width * 8) +
+    "(reinterpret_cast<const " + vector_t + " *>(it));\n"
+    "\t\t\t" + vector_t + " found = " + found + ";\n"
+    "\t\t\tunsigned stop = " + mask + ";\n"
+    "\t\t\tif (stop != 0) {\n"
+    "\t\t\t\treturn it + __builtin_ctz(stop);\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\t\treturn it;\n"
+    "\t}\n"
+    "\n";
+}
+
+std::string run_kernels::generate_functions() const {
+  std::string code =
+    "#ifdef PARSER_SIMD\n"
+    "\t// Static initializers of other translation units may run first, so CPU data is initialized here\n"
+    "\tinline static const bool has_avx2 = [] {\n"
+    "\t\t__builtin_cpu_init();\n"
+    "\t\treturn __builtin_cpu_supports(\"avx2\") != 0;\n"
+    "\t}();\n"
+    "\n"
+    "\tstatic __m128i in_range(__m128i chunk, char from, char len) {\n"
+    "\t\t__m128i shifted = _mm_sub_epi8(chunk, _mm_set1_epi8(from));\n"
+    "\t\treturn _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(len)), shifted);\n"
+    "\t}\n"
+    "\n"
+    "\t__attribute__((target(\"avx2\")))\n"
+    "\tstatic __m256i in_range(__m256i chunk, char from, char len) {\n"
+    "\t\t__m256i shifted = _mm256_sub_epi8(chunk, _mm256_set1_epi8(from));\n"
+    "\t\treturn _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(len)), shifted);\n"
+    "\t}\n"
+    "\n";
+  for (size_t i = 0; i < kernels.size(); i++) {
+    code += generate_kernel(kernels[i], i + 1, 16) + generate_kernel(kernels[i], i + 1, 32);
+  }
+  code += "#endif\n";
+
+  std::string avx2_cases, sse2_cases;
+  for (size_t i = 1; i <= kernels.size(); i++) {
+    avx2_cases +=
+      "\t\t\t\tcase " + std::to_string(i) + ":\n"
+      "\t\t\t\t\treturn skip_run_" + std::to_string(i) + "_avx2(it, end);\n";
+    sse2_cases +=
+      "\t\t\tcase " + std::to_string(i) + ":\n"
+      "\t\t\t\treturn skip_run_" + std::to_string(i) + "_sse2(it, end);\n";
+  }
+  code +=
+    "\n"
+    "\tstatic const char *skip_run(size_t kernel, const char *it, const char *end) {\n"
+    "#ifdef PARSER_SIMD\n"
+    "\t\tif (has_avx2) {\n"
+    "\t\t\tswitch (kernel) {\n" +
+    avx2_cases +
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\t\tswitch (kernel) {\n" +
+    sse2_cases +
+    "\t\t}\n"
+    "#else\n"
+    "\t\t(void) kernel;\n"
+    "\t\t(void) end;\n"
+    "#endif\n"
+    "\t\treturn it;\n"
+    "\t}\n";
+  return code;
+}
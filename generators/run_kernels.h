@@ -0,0 +1,42 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_GENERATORS_RUN_KERNELS_H_
+#define PARSER_GENERATOR_GENERATORS_RUN_KERNELS_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "dfa.h"
+
+/**
+ * SIMD kernels skipping runs of characters on which a DFA state loops to itself (digits, identifiers, spaces...).
+ * Every kernel checks up to MAX_RANGES character ranges, either the loop set itself or its complement.
+ */
+class run_kernels {
+ public:
+  static constexpr size_t MAX_RANGES = 4;
+
+  explicit run_kernels(const dfa &lexer_dfa);
+
+  bool empty() const;
+  size_t size() const;
+  std::string generate_table(const std::string &type) const;
+  std::string generate_functions() const;
+
+ private:
+  struct kernel {
+    std::vector<std::pair<unsigned char, unsigned char>> ranges;
+    bool negated;
+
+    bool operator==(const kernel &other) const;
+  };
+
+  std::vector<kernel> kernels;
+  std::vector<size_t> state_kernels; // 0 if there is no kernel for the state, kernel index + 1 otherwise
+
+  static std::string generate_kernel(const kernel &cur_kernel, size_t id, size_t width);
+};
+
+#endif //PARSER_GENERATOR_GENERATORS_RUN_KERNELS_H_
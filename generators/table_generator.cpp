@@ -0,0 +1,157 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "table_generator.h"
+
+table_generator::table_generator(const generator_options &options,
+                                 const std::unordered_map<std::string, rule> &rules,
+                                 std::vector<std::string> rule_names)
+  : options(options)
+  , rules(rules)
+  , rule_names(std::move(rule_names)) {}
+
+/**
+ * Events of the push parser are virtual functions doing nothing, so the listener overrides only the ones it needs
+ */
+std::string table_generator::generate_declaration() const {
+  if (!options.push) {
+    return "struct table_stack;\n\n";
+  }
+  return
+    tree_generator::generate_node_kinds(rule_names) +
+    "// Rules are entered before their first token and exited after their last one, tokens are reported in order\n"
+    "struct parse_events {\n"
+    "\tvirtual ~parse_events() = default;\n"
+    "\n"
+    "\tvirtual void enter(NODE_KIND) {}\n"
+    "\tvirtual void exit(NODE_KIND) {}\n"
+    "\tvirtual void token(TOKEN_TYPE, std::string_view) {}\n"
+    "};\n"
+    "\n"
+    "struct table_stack;\n"
+    "\n";
+}
+
+/**
+ * Row of the rule maps the lookahead token to the first step of the predicted alternative,
+ * 0 means that no alternative is predicted and the rule stays empty
+ */
+std::string table_generator::generate_predict(const grammar_analyzer &analyzer,
+                                              const lexer_generator &lexer_generator_) const {
+  std::vector<std::string> token_types = lexer_generator_.get_token_types();
+  std::unordered_map<std::string, size_t> type_ids;
+  for (size_t i = 0; i < token_types.size(); i++) {
+    type_ids.emplace(token_types[i], i);
+  }
+
+  std::string code =
+    "static constexpr uint32_t table_predict[" + std::to_string(rule_names.size()) + "]"
+    "[" + std::to_string(token_types.size()) + "] = {\n";
+  for (const auto &rule_name: rule_names) {
+    std::vector<std::string> row(token_types.size(), "0");
+    std::vector<std::vector<std::string>> predict_types = rules.at(rule_name).get_predict_types(analyzer,
+                                                                                                  lexer_generator_);
+    for (size_t rule_id = 0; rule_id < predict_types.size(); rule_id++) {
+      for (const auto &type: predict_types[rule_id]) {
+        std::string &cell = row[type_ids.at(type)];
+        if (cell == "0") {
+          cell = "STATE_" + rule_name + "_" + std::to_string(rule_id) + "_0";
+        }
+      }
+    }
+    code += "\t{";
+    for (size_t i = 0; i < row.size(); i++) {
+      code += (i == 0 ? "" : ", ") + row[i];
+    }
+    code += "}, // " + rule_name + "\n";
+  }
+  code += "};\n";
+  return code;
+}
+
+/**
+ * Steps of all rules share the single switch, a step ending at a child rule pushes its continuation
+ * and the start state of the child, the child value itself is kept on the stack of its rule.
+ * Rule values are destroyed by the vectors, so deep inputs do not need deep recursion anywhere.
+ */
+std::pair<std::string, std::string> table_generator::generate(const grammar_analyzer &analyzer,
+                                                              const lexer_generator &lexer_generator_) const {
+  std::string params = options.flat ? "lexer &lexer_, flat_tree &tree_" : "lexer &lexer_";
+  std::string args = options.flat ? "(lexer_, tree_, stack_)" : "(lexer_, stack_)";
+  std::string states, steps, stacks, needs;
+  for (const auto &rule_name: rule_names) {
+    states += "\tSTATE_" + rule_name + ",\n";
+    stacks += "\tstd::vector<" + rule_name + "_node> " + rule_name + "_nodes;\n";
+    needs += std::string(needs.empty() ? "" : ", ") + "1";
+  }
+  for (const auto &rule_name: rule_names) {
+    std::string nodes = "stack_." + rule_name + "_nodes";
+    for (const auto&[state, child_rule, tokens]: rules.at(rule_name).get_table_states()) {
+      states += "\t" + state + ",\n";
+      needs += ", " + std::to_string(tokens);
+      // The child of the same rule is still above the parent until the step pops it
+      std::string node = child_rule == rule_name ? nodes + "[" + nodes + ".size() - 2]" : nodes + ".back()";
+      std::string step = state.substr(("STATE_" + rule_name + "_").size());
+      steps +=
+        "\t\t\tcase " + state + ":\n"
+        "\t\t\t\t" + node + ".step_" + step + args + ";\n"
+        "\t\t\t\tbreak;\n";
+    }
+  }
+
+  std::string header =
+    "// States less than the number of rules start the rule, others are steps of the alternatives\n"
+    "enum TABLE_STATE : uint32_t {\n" +
+    states +
+    "};\n"
+    "\n"
+    "struct table_stack {\n" +
+    stacks +
+    "\tstd::vector<uint32_t> states;\n" +
+    (options.flat ? "\tstd::vector<size_t> opened;\n" : "") +
+    (options.push ? "\tparse_events ignored;\n\tparse_events *events = &ignored;\n" : "") +
+    "};\n"
+    "\n"
+    "void table_run(" + params + ", table_stack &stack_);\n"
+    "\n";
+  std::string need_tokens, wait_tokens;
+  if (options.push) {
+    // Tokens read by each state, the start of the rule reads the lookahead token
+    need_tokens =
+      "\n"
+      "static constexpr uint32_t table_need[] = {" + needs + "};\n";
+    wait_tokens =
+      "\t\tif (!lexer_.ready(table_need[state])) {\n"
+      "\t\t\treturn;\n"
+      "\t\t}\n";
+  }
+  std::string cpp =
+    generate_predict(analyzer, lexer_generator_) +
+    need_tokens +
+    "\n"
+    "void table_run(" + params + ", table_stack &stack_) {\n"
+    "\twhile (!stack_.states.empty()) {\n"
+    "\t\tuint32_t state = stack_.states.back();\n" +
+    wait_tokens +
+    "\t\tstack_.states.pop_back();\n"
+    "\t\tif (state < " + std::to_string(rule_names.size()) + ") {\n"
+    "\t\t\tTOKEN_TYPE type = lexer_.next().first;\n"
+    "\t\t\tlexer_.undo();\n"
+    "\t\t\tstate = table_predict[state][static_cast<size_t>(type)];\n" +
+    (options.push
+     ? "\t\t\tif (!lexer_.ready(table_need[state])) {\n"
+       "\t\t\t\tstack_.states.push_back(state); // The predicted step waits for its tokens\n"
+       "\t\t\t\treturn;\n"
+       "\t\t\t}\n"
+     : "") +
+    "\t\t}\n"
+    "\t\tswitch (state) {\n" +
+    steps +
+    "\t\t\tdefault:\n"
+    "\t\t\t\tbreak;\n"
+    "\t\t}\n"
+    "\t}\n"
+    "}\n";
+  return {header, cpp};
+}
@@ -0,0 +1,42 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_GENERATORS_TABLE_GENERATOR_H_
+#define PARSER_GENERATOR_GENERATORS_TABLE_GENERATOR_H_
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "generator_options.h"
+#include "lexer_generator.h"
+#include "tree_generator.h"
+#include "../grammar/grammar_analyzer.h"
+#include "../parser/rule.h"
+
+/**
+ * Generates the table parser (--table): states of rule steps, the predict table and the loop running steps
+ * from the explicit stack, so the depth of the input is limited only by the heap.
+ * With --push the loop stops when the lexer has not got the tokens of the next state yet and continues after the
+ * next chunk of the input is fed.
+ */
+class table_generator {
+ public:
+  table_generator(const generator_options &options,
+                  const std::unordered_map<std::string, rule> &rules,
+                  std::vector<std::string> rule_names);
+
+  std::string generate_declaration() const;
+  std::pair<std::string, std::string> generate(const grammar_analyzer &analyzer,
+                                               const lexer_generator &lexer_generator_) const;
+
+ private:
+  generator_options options;
+  const std::unordered_map<std::string, rule> &rules;
+  std::vector<std::string> rule_names;
+
+  std::string generate_predict(const grammar_analyzer &analyzer, const lexer_generator &lexer_generator_) const;
+};
+
+#endif //PARSER_GENERATOR_GENERATORS_TABLE_GENERATOR_H_
@@ -0,0 +1,401 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "tree_generator.h"
+
+tree_generator::tree_generator(const generator_options &options, std::vector<std::string> rule_names)
+  : options(options)
+  , rule_names(std::move(rule_names)) {}
+
+/**
+ * Monotonic arena for tree nodes. Memory is taken from the upstream resource and is not freed until release(),
+ * then the arena keeps a single buffer large enough for the released nodes, so the next parse of similar input
+ * does not touch the upstream resource. Destructors are called only for nodes which have non-trivial ones.
+ */
+std::string tree_generator::generate_arena() {
+  return
+    "class node_arena {\n"
+    " public:\n"
+    "\tnode_arena()\n"
+    "\t\t: node_arena(std::pmr::get_default_resource()) {}\n"
+    "\n"
+    "\texplicit node_arena(std::pmr::memory_resource *upstream)\n"
+    "\t\t: upstream(upstream) {\n"
+    "\t\tresource.emplace(upstream);\n"
+    "\t}\n"
+    "\n"
+    "\tnode_arena(const node_arena &) = delete;\n"
+    "\tnode_arena &operator=(const node_arena &) = delete;\n"
+    "\n"
+    "\t~node_arena() {\n"
+    "\t\tfinalize();\n"
+    "\t\tresource.reset();\n"
+    "\t\tif (buffer != nullptr) {\n"
+    "\t\t\tupstream->deallocate(buffer, buffer_size);\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\n"
+    "\ttemplate<typename T, typename... Args>\n"
+    "\tT *make(Args &&... args) {\n"
+    "\t\tT *node = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);\n"
+    "\t\tif constexpr (!std::is_trivially_destructible_v<T>) {\n"
+    "\t\t\tvoid *memory = allocate(sizeof(finalizer), alignof(finalizer));\n"
+    "\t\t\tfinalizers = new(memory) finalizer{[](void *ptr) { static_cast<T *>(ptr)->~T(); }, node, finalizers};\n"
+    "\t\t}\n"
+    "\t\treturn node;\n"
+    "\t}\n"
+    "\n"
+    "\t// Frees all nodes at once, pointers to them become invalid\n"
+    "\tvoid release() {\n"
+    "\t\tfinalize();\n"
+    "\t\tresource.reset();\n"
+    "\t\tif (allocated > buffer_size) {\n"
+    "\t\t\tif (buffer != nullptr) {\n"
+    "\t\t\t\tupstream->deallocate(buffer, buffer_size);\n"
+    "\t\t\t\tbuffer = nullptr;\n"
+    "\t\t\t}\n"
+    "\t\t\tbuffer = upstream->allocate(allocated);\n"
+    "\t\t\tbuffer_size = allocated;\n"
+    "\t\t}\n"
+    "\t\tallocated = 0;\n"
+    "\t\tif (buffer != nullptr) {\n"
+    "\t\t\tresource.emplace(buffer, buffer_size, upstream);\n"
+    "\t\t} else {\n"
+    "\t\t\tresource.emplace(upstream);\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\n"
+    " private:\n"
+    "\tstruct finalizer {\n"
+    "\t\tvoid (*destroy)(void *);\n"
+    "\t\tvoid *node;\n"
+    "\t\tfinalizer *next;\n"
+    "\t};\n"
+    "\n"
+    "\tvoid *allocate(size_t size, size_t alignment) {\n"
+    "\t\tallocated += size + alignment - 1;\n"
+    "\t\treturn resource->allocate(size, alignment);\n"
+    "\t}\n"
+    "\n"
+    "\tvoid finalize() {\n"
+    "\t\tfor (; finalizers != nullptr; finalizers = finalizers->next) {\n"
+    "\t\t\tfinalizers->destroy(finalizers->node);\n"
+    "\t\t}\n"
+    "\t}\n"
+    "\n"
+    "\tstd::pmr::memory_resource *upstream;\n"
+    "\tstd::optional<std::pmr::monotonic_buffer_resource> resource;\n"
+    "\tvoid *buffer = nullptr;\n"
+    "\tsize_t buffer_size = 0, allocated = 0;\n"
+    "\tfinalizer *finalizers = nullptr;\n"
+    "};\n"
+    "\n";
+}
+
+/**
+ * With --incremental a node is parsed together with its children from the tree before the edit.
+ * An old child of the same rule starting at the same token is reused if its tokens and the token after them
+ * are outside of the damaged window and its inherited variables are the same, otherwise its children are passed
+ * to the new node. Tokens after the window are matched to old ones by the difference of the window ends.
+ */
+std::string tree_generator::generate_old_children() {
+  return
+    "struct old_children {\n"
+    "\tconst reparse_window &window;\n"
+    "\tconst inner_node *node = nullptr;\n"
+    "\tsize_t index = 0, position = 0; // The next old child and its first token before the edit\n"
+    "\n"
+    "\ttemplate<typename T, typename... Args>\n"
+    "\tstd::shared_ptr<T> parse(lexer &lexer_, Args... args) {\n"
+    "\t\tsize_t start = lexer_.token_position();\n"
+    "\t\told_children children{window};\n"
+    "\t\tif (node != nullptr && (start < window.begin || start >= window.new_end)) {\n"
+    "\t\t\tsize_t old_start = start < window.begin ? start : start - window.new_end + window.old_end;\n"
+    "\t\t\tfor (; index < node->children.size() && position <= old_start;\n"
+    "\t\t\t     position += node->children[index++]->tokens_count) {\n"
+    "\t\t\t\tif (position != old_start || node->children[index]->kind != T::KIND) {\n"
+    "\t\t\t\t\tcontinue;\n"
+    "\t\t\t\t}\n"
+    "\t\t\t\tauto *old = static_cast<T *>(node->children[index].get());\n"
+    "\t\t\t\tstd::shared_ptr<base_node> old_node = node->children[index++];\n"
+    "\t\t\t\tposition += old->tokens_count;\n"
+    "\t\t\t\tif ((old_start + old->tokens_count < window.begin || old_start >= window.old_end)\n"
+    "\t\t\t\t    && old->inherited == decltype(old->inherited)(args...)) {\n"
+    "\t\t\t\t\tlexer_.seek(start + old->tokens_count);\n"
+    "\t\t\t\t\treturn std::static_pointer_cast<T>(old_node);\n"
+    "\t\t\t\t}\n"
+    "\t\t\t\tchildren.node = old;\n"
+    "\t\t\t\tchildren.position = old_start;\n"
+    "\t\t\t\tbreak;\n"
+    "\t\t\t}\n"
+    "\t\t}\n"
+    "\t\tauto new_node = std::make_shared<T>(std::move(args)...);\n"
+    "\t\tnew_node->parse(lexer_, children);\n"
+    "\t\tnew_node->tokens_count = lexer_.token_position() - start;\n"
+    "\t\treturn new_node;\n"
+    "\t}\n"
+    "};\n"
+    "\n";
+}
+
+std::string tree_generator::generate_node_kinds(const std::vector<std::string> &rule_names) {
+  std::string kinds;
+  for (const auto &rule_name: rule_names) {
+    kinds += "\t" + rule_name + ",\n";
+  }
+  return
+    "enum class NODE_KIND : uint16_t {\n"
+    "\tTEXT,\n" +
+    kinds +
+    "};\n"
+    "\n";
+}
+
+/**
+ * Without --arena nodes are owned by shared pointers, with --arena children are non-owning pointers linked
+ * into the list, so the nodes have trivial destructors unless their variables have non-trivial ones.
+ * Nodes have no virtual functions, the kind of the node tells its type.
+ */
+std::string tree_generator::generate() const {
+  if (options.flat) {
+    return
+      generate_node_kinds(rule_names) +
+      "// Text nodes keep the token type in attrs, rule nodes keep the index in the side table of the rule\n"
+      "struct flat_node {\n"
+      "\tNODE_KIND kind;\n"
+      "\tuint32_t attrs;\n"
+      "\tuint32_t begin, end;\n"
+      "\tuint32_t size;\n"
+      "};\n"
+      "\n"
+      "struct flat_tree;\n"
+      "\n";
+  }
+  if (!options.arena) {
+    std::string tokens_count = options.incremental ? "\n\tsize_t tokens_count = 0;\n" : "";
+    std::string text_tokens_count = options.incremental ? " {\n\t\ttokens_count = 1;\n\t}\n" : " {}\n";
+    return
+      generate_node_kinds(rule_names) +
+      "struct base_node {\n"
+      "\texplicit base_node(NODE_KIND kind) : kind(kind) {}\n"
+      "\n"
+      "\tNODE_KIND kind;\n" +
+      tokens_count +
+      "};\n"
+      "\n"
+      "struct text_node : public base_node {\n"
+      "\ttext_node(text_t text_) : base_node(NODE_KIND::TEXT), text(std::move(text_))" + text_tokens_count +
+      "\n"
+      "\ttext_t text;\n"
+      "};\n"
+      "\n"
+      "struct inner_node : public base_node {\n"
+      "\tusing base_node::base_node;\n"
+      "\n"
+      "\tvoid add_child(const std::shared_ptr<base_node> &node) {\n"
+      "\t\tchildren.push_back(node);\n"
+      "\t}\n"
+      "\n"
+      "\tstd::vector<std::shared_ptr<base_node>> children;\n"
+      "};\n"
+      "\n" +
+      (options.incremental ? generate_old_children() : "");
+  }
+  return
+    generate_node_kinds(rule_names) +
+    generate_arena() +
+    "struct base_node {\n"
+    "\texplicit base_node(NODE_KIND kind) : kind(kind) {}\n"
+    "\n"
+    "\tNODE_KIND kind;\n"
+    "\tbase_node *next_sibling = nullptr;\n"
+    "};\n"
+    "\n"
+    "struct text_node : public base_node {\n"
+    "\ttext_node(text_t text_) : base_node(NODE_KIND::TEXT), text(std::move(text_)) {}\n"
+    "\n"
+    "\ttext_t text;\n"
+    "};\n"
+    "\n"
+    "struct inner_node : public base_node {\n"
+    "\tusing base_node::base_node;\n"
+    "\n"
+    "\tvoid add_child(base_node *node) {\n"
+    "\t\t(last_child == nullptr ? first_child : last_child->next_sibling) = node;\n"
+    "\t\tlast_child = node;\n"
+    "\t}\n"
+    "\n"
+    "\tbase_node *first_child = nullptr;\n"
+    "\tbase_node *last_child = nullptr;\n"
+    "};\n"
+    "\n";
+}
+
+/**
+ * Nodes are stored in preorder and each node knows the size of its subtree, so children are reached by index
+ * arithmetic: the first child follows the node and the next sibling follows the subtree. Variables of the rules
+ * are kept in per-rule tables, text is not copied, nodes store offsets of their spans in the input.
+ */
+std::string tree_generator::generate_flat_tree() const {
+  std::string tables, getters;
+  for (const auto &rule_name: rule_names) {
+    tables += "\tstd::vector<" + rule_name + "_node> " + rule_name + "_attrs;\n";
+    getters +=
+      "\tconst " + rule_name + "_node &get_" + rule_name + "(uint32_t node) const {\n"
+      "\t\treturn " + rule_name + "_attrs[nodes[node].attrs];\n"
+      "\t}\n"
+      "\n";
+  }
+  return
+    "struct flat_tree {\n" +
+    getters +
+    "\tNODE_KIND kind(uint32_t node) const {\n"
+    "\t\treturn nodes[node].kind;\n"
+    "\t}\n"
+    "\n"
+    "\tTOKEN_TYPE token(uint32_t node) const {\n"
+    "\t\treturn static_cast<TOKEN_TYPE>(nodes[node].attrs);\n"
+    "\t}\n"
+    "\n"
+    "\tstd::string_view text(std::string_view input, uint32_t node) const {\n"
+    "\t\treturn input.substr(nodes[node].begin, nodes[node].end - nodes[node].begin);\n"
+    "\t}\n"
+    "\n"
+    "\t// Children of the node are first_child(node), next_sibling(child), ... up to subtree_end(node)\n"
+    "\tuint32_t first_child(uint32_t node) const {\n"
+    "\t\treturn node + 1;\n"
+    "\t}\n"
+    "\n"
+    "\tuint32_t next_sibling(uint32_t node) const {\n"
+    "\t\treturn node + nodes[node].size;\n"
+    "\t}\n"
+    "\n"
+    "\tuint32_t subtree_end(uint32_t node) const {\n"
+    "\t\treturn node + nodes[node].size;\n"
+    "\t}\n"
+    "\n"
+    "\tsize_t open(NODE_KIND kind, size_t begin) {\n"
+    "\t\tcheck_offset(begin);\n"
+    "\t\tnodes.push_back({kind, 0, static_cast<uint32_t>(begin), 0, 0});\n"
+    "\t\treturn nodes.size() - 1;\n"
+    "\t}\n"
+    "\n"
+    "\ttemplate<typename T>\n"
+    "\tvoid close(size_t node, size_t end, std::vector<T> &attrs, T &&value) {\n"
+    "\t\tcheck_offset(end);\n"
+    "\t\tnodes[node].attrs = static_cast<uint32_t>(attrs.size());\n"
+    "\t\tnodes[node].end = static_cast<uint32_t>(end);\n"
+    "\t\tnodes[node].size = static_cast<uint32_t>(nodes.size() - node);\n"
+    "\t\tattrs.push_back(std::move(value));\n"
+    "\t}\n"
+    "\n"
+    "\tvoid add_text(TOKEN_TYPE type, size_t begin, size_t end) {\n"
+    "\t\tcheck_offset(end);\n"
+    "\t\tnodes.push_back({NODE_KIND::TEXT, static_cast<uint32_t>(type), static_cast<uint32_t>(begin), static_cast<uint32_t>(end), 1});\n"
+    "\t}\n"
+    "\n"
+    "\tstd::vector<flat_node> nodes;\n" +
+    tables +
+    "\n"
+    " private:\n"
+    "\tstatic void check_offset(size_t offset) {\n"
+    "\t\tif (offset > UINT32_MAX) {\n"
+    "\t\t\tthrow std::runtime_error(\"Input is too large for the flat tree\");\n"
+    "\t\t}\n"
+    "\t}\n"
+    "};\n"
+    "\n";
+}
+
+/**
+ * The walk keeps open nodes on the explicit stack, so deep trees do not need deep recursion.
+ * Hooks of the derived visitor hide the empty ones of the base and are called by the switch over node kinds,
+ * so nothing is virtual and the hooks may be inlined into the walk.
+ */
+std::string tree_generator::generate_visitor() const {
+  std::string hooks, enter_cases, leave_cases;
+  for (const auto &rule_name: rule_names) {
+    std::string node = rule_name + "_node";
+    hooks +=
+      "\tbool visit_" + rule_name + "(" + node + " &) {\n"
+      "\t\treturn true;\n"
+      "\t}\n"
+      "\n"
+      "\tvoid leave_" + rule_name + "(" + node + " &) {}\n"
+      "\n";
+    enter_cases +=
+      "\t\t\tcase NODE_KIND::" + rule_name + ":\n"
+      "\t\t\t\twalk_children = self().visit_" + rule_name + "(static_cast<" + node + " &>(node));\n"
+      "\t\t\t\tbreak;\n";
+    leave_cases +=
+      "\t\t\tcase NODE_KIND::" + rule_name + ":\n"
+      "\t\t\t\tself().leave_" + rule_name + "(static_cast<" + node + " &>(node));\n"
+      "\t\t\t\tbreak;\n";
+  }
+  // With --arena children are linked by siblings, otherwise they are indexed in the vector of the parent
+  std::string frame = options.arena ? "\t\tbase_node *next;\n" : "\t\tsize_t next;\n";
+  std::string children_end = options.arena ? "nullptr" : "top.node->children.size()";
+  std::string next_child = options.arena
+    ? "\t\t\tbase_node &child = *top.next;\n"
+      "\t\t\ttop.next = child.next_sibling;\n"
+      "\t\t\tenter(child, stack);\n"
+    : "\t\t\tenter(*top.node->children[top.next++], stack);\n";
+  std::string first_child = options.arena ? "inner.first_child" : "0";
+  std::string no_children = options.arena ? "nullptr" : "inner.children.size()";
+  return
+    "// Preorder walk of the tree: visit_<rule> returns whether to walk the children of the node,\n"
+    "// leave_<rule> is called after them. Derived visitor defines only the hooks it needs.\n"
+    "template<typename Derived>\n"
+    "class tree_visitor {\n"
+    " public:\n"
+    "\tvoid walk(base_node &root) {\n"
+    "\t\tstd::vector<frame> stack;\n"
+    "\t\tenter(root, stack);\n"
+    "\t\twhile (!stack.empty()) {\n"
+    "\t\t\tframe &top = stack.back();\n"
+    "\t\t\tif (top.next == " + children_end + ") {\n"
+    "\t\t\t\tinner_node &node = *top.node;\n"
+    "\t\t\t\tstack.pop_back();\n"
+    "\t\t\t\tleave(node);\n"
+    "\t\t\t\tcontinue;\n"
+    "\t\t\t}\n" +
+    next_child +
+    "\t\t}\n"
+    "\t}\n"
+    "\n" +
+    hooks +
+    "\tvoid visit_text(text_node &) {}\n"
+    "\n"
+    " private:\n"
+    "\tstruct frame {\n"
+    "\t\tinner_node *node;\n" +
+    frame +
+    "\t};\n"
+    "\n"
+    "\tDerived &self() {\n"
+    "\t\treturn static_cast<Derived &>(*this);\n"
+    "\t}\n"
+    "\n"
+    "\tvoid enter(base_node &node, std::vector<frame> &stack) {\n"
+    "\t\tbool walk_children = false;\n"
+    "\t\tswitch (node.kind) {\n"
+    "\t\t\tcase NODE_KIND::TEXT:\n"
+    "\t\t\t\tself().visit_text(static_cast<text_node &>(node));\n"
+    "\t\t\t\treturn;\n" +
+    enter_cases +
+    "\t\t}\n"
+    "\t\tauto &inner = static_cast<inner_node &>(node);\n"
+    "\t\tstack.push_back({&inner, walk_children ? " + first_child + " : " + no_children + "});\n"
+    "\t}\n"
+    "\n"
+    "\tvoid leave(inner_node &node) {\n"
+    "\t\tswitch (node.kind) {\n" +
+    leave_cases +
+    "\t\t\tdefault:\n"
+    "\t\t\t\tbreak;\n"
+    "\t\t}\n"
+    "\t}\n"
+    "};\n"
+    "\n";
+}
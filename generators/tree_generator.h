@@ -0,0 +1,35 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_GENERATORS_TREE_GENERATOR_H_
+#define PARSER_GENERATOR_GENERATORS_TREE_GENERATOR_H_
+
+#include <string>
+#include <vector>
+#include "generator_options.h"
+
+/**
+ * Generates node kinds and base classes of the parse tree nodes and, with --arena, the arena allocating them.
+ * After the rule classes generates the visitor of the tree or, with --flat, the flat tree.
+ * With --incremental nodes know how many tokens they cover and are reparsed reusing the old tree.
+ */
+class tree_generator {
+ public:
+  tree_generator(const generator_options &options, std::vector<std::string> rule_names);
+
+  std::string generate() const;
+  std::string generate_flat_tree() const;
+  std::string generate_visitor() const;
+
+  static std::string generate_node_kinds(const std::vector<std::string> &rule_names);
+
+ private:
+  generator_options options;
+  std::vector<std::string> rule_names;
+
+  static std::string generate_arena();
+  static std::string generate_old_children();
+};
+
+#endif //PARSER_GENERATOR_GENERATORS_TREE_GENERATOR_H_
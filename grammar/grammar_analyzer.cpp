@@ -3,156 +3,745 @@
 //
 
 #include "grammar_analyzer.h"
-#include <sstream>
 #include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include "../utils/task_graph.h"
 
-grammar_analyzer::grammar_analyzer(const std::vector<rule_cfg>& rules_cfg, const std::string& start) {
-  for (const rule_cfg& cur_rule: rules_cfg) {
-    const auto& rule_name = cur_rule.name;
-    auto cur_rules = rules.insert({rule_name, {}}).first;
-    cur_rules->second.emplace_back();
-    for (const auto&[type, data]: cur_rule.data) {
-      cur_rules->second.back().push_back(data);
-      if (type == RULE_TYPE::TEXT || type == RULE_TYPE::TRANSITION_REGEX) {
-        terminals.insert(data);
+static const size_t NONE = static_cast<size_t>(-1);
+// Analysis takes about 300 ns per symbol of the grammar and starting a thread about 20 us,
+// a thread is started for every 8192 symbols, so the threads of the five parallel passes cost under 5%
+static const size_t MIN_SYMBOLS_PER_THREAD = 8192;
+// Solving a component takes about as long as queueing a task, so tasks solve batches of components
+static const size_t MIN_RULES_PER_TASK = 256;
+// Rules are split into more blocks than threads, so a thread with cheap rules steals the blocks of others
+static const size_t BLOCKS_PER_THREAD = 4;
+// A sorted vector of 32-bit ids is smaller than the bitset while it holds less than 1/32 of the terminals
+static const size_t SPARSE_RATIO = 32;
+
+/**
+ * Strongly connected components of the graph by the Tarjan's algorithm without recursion,
+ * a component is numbered after all the components it depends on. Returns the number of components.
+ */
+static size_t find_components(const std::vector<std::vector<size_t>> &depends, std::vector<size_t> &component) {
+  size_t n = depends.size(), visited = 0, count = 0;
+  std::vector<size_t> index(n, NONE), low(n), stack;
+  std::vector<bool> on_stack(n, false);
+  // Vertex and its next edge for every call of the depth-first search
+  std::vector<std::pair<size_t, size_t>> calls;
+  component.assign(n, NONE);
+  for (size_t root = 0; root < n; root++) {
+    if (index[root] != NONE) {
+      continue;
+    }
+    calls.emplace_back(root, 0);
+    while (!calls.empty()) {
+      size_t v = calls.back().first, edge = calls.back().second;
+      if (edge == 0) {
+        index[v] = low[v] = visited++;
+        stack.push_back(v);
+        on_stack[v] = true;
+      }
+      if (edge < depends[v].size()) {
+        calls.back().second++;
+        size_t u = depends[v][edge];
+        if (index[u] == NONE) {
+          calls.emplace_back(u, 0);
+        } else if (on_stack[u]) {
+          low[v] = std::min(low[v], index[u]);
+        }
+        continue;
+      }
+      calls.pop_back();
+      if (!calls.empty()) {
+        size_t parent = calls.back().first;
+        low[parent] = std::min(low[parent], low[v]);
+      }
+      if (low[v] == index[v]) {
+        size_t u;
+        do {
+          u = stack.back();
+          stack.pop_back();
+          on_stack[u] = false;
+          component[u] = count;
+        } while (u != v);
+        count++;
       }
     }
   }
+  return count;
+}
 
-  for (auto&[non_term, cur_rules]: rules) {
-    if (non_term == start) {
-      std::for_each(cur_rules.begin(), cur_rules.end(), [](auto &rule) { rule.emplace_back("END"); });
+/**
+ * Most components are single rules, so a task per component would cost more than solving it. Components are
+ * taken in the topological order and joined to the latest batch of their dependencies, or to the latest batch
+ * of components without dependencies, while it has less than MIN_RULES_PER_TASK rules. So batches depend
+ * only on earlier batches, and chains of rules are solved by one task. Returns the components of every batch.
+ */
+static std::vector<std::vector<size_t>> make_batches(const std::vector<std::vector<size_t>> &depends,
+                                                     const std::vector<size_t> &component,
+                                                     const std::vector<std::vector<size_t>> &members,
+                                                     std::vector<size_t> &batch) {
+  std::vector<std::vector<size_t>> batches;
+  std::vector<size_t> batch_rules;
+  batch.assign(members.size(), NONE);
+  size_t sources_batch = NONE;
+  for (size_t cur = 0; cur < members.size(); cur++) {
+    size_t target = NONE;
+    bool external = false;
+    for (size_t rule_id: members[cur]) {
+      for (size_t dependency: depends[rule_id]) {
+        if (component[dependency] != cur) {
+          size_t dependency_batch = batch[component[dependency]];
+          external |= target != NONE && target != dependency_batch;
+          target = target == NONE ? dependency_batch : std::max(target, dependency_batch);
+        }
+      }
     }
+    bool source = target == NONE;
+    if (source) {
+      target = sources_batch;
+    }
+    if (target != NONE && batch_rules[target] >= MIN_RULES_PER_TASK) {
+      target = NONE;
+    }
+    if (target == NONE) {
+      target = batches.size();
+      batches.emplace_back();
+      batch_rules.push_back(0);
+      if (source) {
+        sources_batch = target;
+      }
+    }
+    // Components without dependencies must not wait for the dependencies of the batch
+    if (external && target == sources_batch) {
+      sources_batch = NONE;
+    }
+    batch[cur] = target;
+    batches[target].push_back(cur);
+    batch_rules[target] += members[cur].size();
   }
+  return batches;
+}
 
-  this->start = start;
-  terminals.emplace("END");
-  init_first();
-  init_follow();
-  check_ll1();
+grammar_analyzer::terminal_set::terminal_set(size_t universe)
+  : universe(universe) {}
+
+grammar_analyzer::terminal_set::terminal_set(size_t universe, std::vector<uint32_t> &&ids)
+  : universe(universe), count(ids.size()), ids(std::move(ids)) {
+  if (count * SPARSE_RATIO > universe) {
+    make_dense();
+  }
 }
 
-void grammar_analyzer::init_first() {
-  for (const auto&[non_terminal, _]: rules) {
-    first.insert({{non_terminal}, {}});
+void grammar_analyzer::terminal_set::make_dense() {
+  words.assign((universe + 63) / 64, 0);
+  for (uint32_t terminal: ids) {
+    words[terminal / 64] |= uint64_t(1) << (terminal % 64);
+  }
+  std::vector<uint32_t>().swap(ids);
+  dense = true;
+}
+
+void grammar_analyzer::terminal_set::insert(size_t terminal) {
+  if (dense) {
+    uint64_t bit = uint64_t(1) << (terminal % 64);
+    count += (words[terminal / 64] & bit) == 0;
+    words[terminal / 64] |= bit;
+    return;
+  }
+  auto it = std::lower_bound(ids.begin(), ids.end(), terminal);
+  if (it != ids.end() && *it == terminal) {
+    return;
+  }
+  ids.insert(it, static_cast<uint32_t>(terminal));
+  if (++count * SPARSE_RATIO > universe) {
+    make_dense();
+  }
+}
+
+bool grammar_analyzer::terminal_set::merge(const terminal_set &other) {
+  size_t old_count = count;
+  if (!dense && !other.dense) {
+    if (other.count == 1) {
+      insert(other.ids.front());
+      return count != old_count;
+    }
+    // Buffers of the merged vectors are reused by the next merges of the thread
+    static thread_local std::vector<uint32_t> merged;
+    merged.clear();
+    std::set_union(ids.begin(), ids.end(), other.ids.begin(), other.ids.end(), std::back_inserter(merged));
+    ids.swap(merged);
+    count = ids.size();
+    if (count * SPARSE_RATIO > universe) {
+      make_dense();
+    }
+    return count != old_count;
+  }
+  if (!dense) {
+    make_dense();
+  }
+  if (!other.dense) {
+    for (uint32_t terminal: other.ids) {
+      insert(terminal);
+    }
+    return count != old_count;
+  }
+  for (size_t i = 0; i < words.size(); i++) {
+    count += static_cast<size_t>(__builtin_popcountll(other.words[i] & ~words[i]));
+    words[i] |= other.words[i];
+  }
+  return count != old_count;
+}
+
+bool grammar_analyzer::terminal_set::contains(size_t terminal) const {
+  if (dense) {
+    return (words[terminal / 64] >> (terminal % 64) & 1) != 0;
+  }
+  return std::binary_search(ids.begin(), ids.end(), terminal);
+}
+
+size_t grammar_analyzer::terminal_set::size() const {
+  return count;
+}
+
+// Makes the set sparse again, the bitset is filled anew when the set grows, which is paid by the inserted ids
+void grammar_analyzer::terminal_set::clear() {
+  ids.clear();
+  words.clear();
+  count = 0;
+  dense = false;
+}
+
+size_t grammar_analyzer::rule_sets::size(size_t rule_id) const {
+  return rule_node[rule_id] == NONE ? 0 : sizes[rule_node[rule_id]];
+}
+
+bool grammar_analyzer::rule_sets::contains(size_t rule_id, size_t terminal) const {
+  return node_contains(rule_node[rule_id], terminal);
+}
+
+// Nodes are walked down to the first one which may have the terminal, so the walk is never longer than the set
+bool grammar_analyzer::rule_sets::node_contains(size_t node, size_t terminal) const {
+  for (; node != NONE && node >= min_node[terminal]; node = base[node]) {
+    if (added[node].contains(terminal)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+grammar_analyzer::grammar_analyzer(const std::vector<rule_cfg> &rules_cfg, const std::string &start, size_t threads) {
+  size_t symbols = 0;
+  for (const rule_cfg &cur_rule: rules_cfg) {
+    symbols += cur_rule.data.size();
+  }
+  terminal_ids.reserve(symbols + 2);
+  rule_ids.reserve(rules_cfg.size());
+  auto add_terminal = [this](const std::string &terminal) {
+    auto it = terminal_ids.try_emplace(terminal, terminal_names.size());
+    if (it.second) {
+      terminal_names.push_back(terminal);
+    }
+    return it.first->second;
+  };
+  add_terminal("END");
+  add_terminal("EPS");
+  // Terminals are interned by the first pass, rules by the second one, when all of them are known
+  std::vector<size_t> cfg_rule_ids;
+  std::vector<std::vector<symbol_t>> alternatives;
+  cfg_rule_ids.reserve(rules_cfg.size());
+  alternatives.reserve(rules_cfg.size());
+  for (const rule_cfg &cur_rule: rules_cfg) {
+    auto rule_it = rule_ids.try_emplace(cur_rule.name, rule_names.size());
+    if (rule_it.second) {
+      rule_names.push_back(cur_rule.name);
+    }
+    cfg_rule_ids.push_back(rule_it.first->second);
+    std::vector<symbol_t> alternative;
+    alternative.reserve(cur_rule.data.size() + 1);
+    for (const auto&[type, data]: cur_rule.data) {
+      bool terminal = type == RULE_TYPE::TEXT || type == RULE_TYPE::TRANSITION_REGEX;
+      alternative.push_back(terminal ? add_terminal(data) : NONE);
+    }
+    alternatives.push_back(std::move(alternative));
   }
-  for (const auto &terminal: terminals) {
-    first.insert({{terminal}, {terminal}});
+  end_terminal = terminal_ids.at("END");
+  eps_terminal = terminal_ids.at("EPS");
+  auto start_it = rule_ids.find(start);
+  if (start_it == rule_ids.end()) {
+    throw std::runtime_error("Start rule " + start + " is not defined");
   }
-  first[{"END"}].insert("EPS");
+  this->start = start_it->second;
 
-  while (true) {
-    bool updated = false;
-    for (const auto&[non_terminal, cur_rules]: rules) {
-      auto &cur_first = first[{non_terminal}];
-      for (const auto &rule: cur_rules) {
-        auto old_size = cur_first.size();
-        const auto &merge_first = get_first(rule);
-        cur_first.insert(merge_first.begin(), merge_first.end());
-        updated |= cur_first.size() != old_size;
+  rules.resize(rule_names.size());
+  this->threads = std::min<size_t>(std::max<size_t>(1, threads), symbols / MIN_SYMBOLS_PER_THREAD);
+  for (size_t i = 0; i < rules_cfg.size(); i++) {
+    std::vector<symbol_t> &alternative = alternatives[i];
+    for (size_t j = 0; j < alternative.size(); j++) {
+      if (alternative[j] == NONE) {
+        alternative[j] = intern(rules_cfg[i].data[j].second);
       }
     }
-    if (!updated) {
-      break;
+    if (cfg_rule_ids[i] == this->start) {
+      alternative.push_back(end_terminal);
     }
+    rules[cfg_rule_ids[i]].push_back(std::move(alternative));
   }
+
+  init_nullable();
+  init_first();
+  init_follow();
+  check_ll1();
 }
 
-std::set<std::string> grammar_analyzer::get_first(const std::vector<std::string> &rule) {
-  if (rule.empty()) {
-    return {"EPS"};
+grammar_analyzer::symbol_t grammar_analyzer::intern(const std::string &symbol) const {
+  auto terminal = terminal_ids.find(symbol);
+  if (terminal != terminal_ids.end()) {
+    return terminal->second;
   }
-  auto cached_first = first.find(rule);
-  if (cached_first != first.end() && (!cached_first->second.empty() || rule.size() == 1)) {
-    return cached_first->second;
+  auto rule_id = rule_ids.find(symbol);
+  if (rule_id == rule_ids.end()) {
+    throw std::runtime_error("Rule " + symbol + " is not defined");
   }
+  return terminal_names.size() + rule_id->second;
+}
 
-  if (terminals.find(rule[0]) == terminals.end()) {
-    first[rule] = get_first({rule[0]});
-  } else {
-    first[rule] = {rule[0]};
+bool grammar_analyzer::is_terminal(symbol_t symbol) const {
+  return symbol < terminal_names.size();
+}
+
+bool grammar_analyzer::symbol_nullable(symbol_t symbol) const {
+  if (is_terminal(symbol)) {
+    return symbol == end_terminal || symbol == eps_terminal;
   }
+  return nullable[symbol - terminal_names.size()];
+}
+
+bool grammar_analyzer::add_first(symbol_t symbol, terminal_set &set) const {
+  if (!is_terminal(symbol)) {
+    std::vector<uint32_t> ids;
+    ids.reserve(first.size(symbol - terminal_names.size()));
+    first.for_each(symbol - terminal_names.size(), [&ids](size_t terminal) {
+      ids.push_back(static_cast<uint32_t>(terminal));
+    });
+    std::sort(ids.begin(), ids.end());
+    set.merge(terminal_set(terminal_names.size(), std::move(ids)));
+  } else if (symbol != eps_terminal) {
+    set.insert(symbol);
+  }
+  return symbol_nullable(symbol);
+}
 
-  std::set<std::string> &first_rule = first[rule];
-  if (rule.size() > 1 && first_rule.count("EPS")) {
-    std::vector<std::string> rule_suffix(rule.begin() + 1, rule.end());
-    for (const auto &s: get_first(rule_suffix)) {
-      first_rule.insert(s);
+size_t grammar_analyzer::blocks_count() const {
+  return threads < 2 ? 1 : threads * BLOCKS_PER_THREAD;
+}
+
+template<typename F>
+void grammar_analyzer::for_each_block(F f) const {
+  size_t blocks = blocks_count();
+  if (blocks == 1) {
+    f(0, 0, rules.size());
+    return;
+  }
+  task_graph(blocks).run([&](size_t block) {
+    f(block, rules.size() * block / blocks, rules.size() * (block + 1) / blocks);
+  }, threads);
+}
+
+/**
+ * Every alternative waits for its rules to become nullable, a rule is nullable when one of its alternatives is done
+ */
+void grammar_analyzer::init_nullable() {
+  nullable.assign(rules.size(), false);
+  std::vector<std::vector<size_t>> remaining(rules.size());
+  std::vector<std::vector<std::pair<size_t, size_t>>> occurrences(rules.size());
+  std::vector<size_t> worklist;
+  for (size_t rule_id = 0; rule_id < rules.size(); rule_id++) {
+    for (size_t alternative = 0; alternative < rules[rule_id].size(); alternative++) {
+      const auto &symbols = rules[rule_id][alternative];
+      bool has_terminal = std::any_of(symbols.begin(), symbols.end(), [this](symbol_t symbol) {
+        return is_terminal(symbol) && !symbol_nullable(symbol);
+      });
+      size_t count = 0;
+      if (!has_terminal) {
+        for (symbol_t symbol: symbols) {
+          if (!is_terminal(symbol)) {
+            occurrences[symbol - terminal_names.size()].emplace_back(rule_id, alternative);
+            count++;
+          }
+        }
+      }
+      remaining[rule_id].push_back(has_terminal ? NONE : count);
+      if (count == 0 && !has_terminal && !nullable[rule_id]) {
+        nullable[rule_id] = true;
+        worklist.push_back(rule_id);
+      }
+    }
+  }
+  while (!worklist.empty()) {
+    size_t rule_id = worklist.back();
+    worklist.pop_back();
+    for (const auto&[parent, alternative]: occurrences[rule_id]) {
+      if (--remaining[parent][alternative] == 0 && !nullable[parent]) {
+        nullable[parent] = true;
+        worklist.push_back(parent);
+      }
     }
   }
-  return first_rule;
 }
 
-void grammar_analyzer::init_follow() {
-  follow[start].emplace("END");
-  while (true) {
-    bool changed = false;
-    for (const auto&[A, rules_a]: rules) {
-      for (const auto &rule: rules_a) {
-        for (size_t i = 0; i < rule.size(); i++) {
-          const auto &B = rule[i];
-          if (terminals.find(B) != terminals.end()) {
-            continue;
+/**
+ * FIRST of a rule includes FIRST of every symbol of its alternatives up to the first one which can not be empty
+ */
+void grammar_analyzer::init_first() {
+  std::vector<terminal_set> own(rules.size(), terminal_set(terminal_names.size()));
+  std::vector<std::vector<size_t>> depends(rules.size());
+  for_each_block([&](size_t, size_t begin, size_t end) {
+    for (size_t rule_id = begin; rule_id < end; rule_id++) {
+      for (const auto &alternative: rules[rule_id]) {
+        for (symbol_t symbol: alternative) {
+          if (is_terminal(symbol)) {
+            add_first(symbol, own[rule_id]);
+          } else if (symbol - terminal_names.size() != rule_id) {
+            depends[rule_id].push_back(symbol - terminal_names.size());
           }
-          std::vector<std::string> suffix(rule.begin() + static_cast<std::ptrdiff_t>(i) + 1, rule.end());
-          auto old_size = follow[B].size();
-          const auto &suffix_first = get_first(suffix);
-          follow[B].insert(suffix_first.begin(), suffix_first.end());
-          if (follow[B].erase("EPS") > 0) {
-            follow[B].insert(follow[A].begin(), follow[A].end());
+          if (!symbol_nullable(symbol)) {
+            break;
           }
-          changed |= old_size != follow[B].size();
         }
       }
     }
-    if (!changed) {
+  });
+  propagate(own, depends, first);
+}
+
+std::set<std::string> grammar_analyzer::get_first(const std::vector<std::string> &rule) const {
+  std::set<std::string> res;
+  auto insert = [&](size_t terminal) {
+    res.insert(terminal_names[terminal]);
+  };
+  bool rule_nullable = true;
+  for (const auto &symbol: rule) {
+    symbol_t cur = intern(symbol);
+    if (!is_terminal(cur)) {
+      first.for_each(cur - terminal_names.size(), insert);
+    } else if (cur != eps_terminal) {
+      insert(cur);
+    }
+    if (!symbol_nullable(cur)) {
+      rule_nullable = false;
       break;
     }
   }
+  if (rule_nullable) {
+    res.insert("EPS");
+  }
+  return res;
 }
 
-std::string rule_to_string(const std::string &non_terminal, const std::vector<std::string> &rule) {
-  std::string s = non_terminal + " :";
-  for (const auto &r: rule) {
-    if (r != "END") {
-      s += " " + r;
+/**
+ * A single backward pass over every alternative collects FIRST of the suffixes after rules,
+ * rules followed by a nullable suffix depend on FOLLOW of the rule. Blocks of rules are passed in parallel,
+ * every block lists what it found sorted by the rule, then blocks of rules collect their lists from all blocks.
+ */
+void grammar_analyzer::init_follow() {
+  // Terminals following rules and rules whose FOLLOW they include, sorted by the rules
+  struct follow_part {
+    std::vector<std::pair<size_t, uint32_t>> terminals;
+    std::vector<std::pair<size_t, size_t>> depends;
+  };
+  std::vector<follow_part> parts(blocks_count());
+  for_each_block([&](size_t block, size_t begin, size_t end) {
+    follow_part &part = parts[block];
+    terminal_set suffix(terminal_names.size());
+    for (size_t rule_id = begin; rule_id < end; rule_id++) {
+      for (const auto &alternative: rules[rule_id]) {
+        suffix.clear();
+        bool suffix_nullable = true;
+        for (auto it = alternative.rbegin(); it != alternative.rend(); ++it) {
+          symbol_t symbol = *it;
+          if (!is_terminal(symbol)) {
+            size_t child = symbol - terminal_names.size();
+            suffix.for_each([&](size_t terminal) {
+              part.terminals.emplace_back(child, static_cast<uint32_t>(terminal));
+            });
+            if (suffix_nullable && child != rule_id) {
+              part.depends.emplace_back(child, rule_id);
+            }
+          }
+          // FIRST of the whole alternative is not needed
+          if (std::next(it) == alternative.rend()) {
+            break;
+          }
+          if (!symbol_nullable(symbol)) {
+            suffix.clear();
+            suffix_nullable = false;
+          }
+          add_first(symbol, suffix);
+        }
+      }
+    }
+    std::sort(part.terminals.begin(), part.terminals.end());
+    std::sort(part.depends.begin(), part.depends.end());
+  });
+
+  std::vector<terminal_set> own(rules.size());
+  std::vector<std::vector<size_t>> depends(rules.size());
+  for_each_block([&](size_t, size_t begin, size_t end) {
+    // Positions of the first entries of the current rule in every part
+    std::vector<size_t> terminal_pos, depend_pos;
+    for (const follow_part &part: parts) {
+      terminal_pos.push_back(std::lower_bound(part.terminals.begin(), part.terminals.end(),
+                                              std::make_pair(begin, uint32_t(0))) - part.terminals.begin());
+      depend_pos.push_back(std::lower_bound(part.depends.begin(), part.depends.end(),
+                                            std::make_pair(begin, size_t(0))) - part.depends.begin());
     }
-  }
-  return s;
+    for (size_t rule_id = begin; rule_id < end; rule_id++) {
+      std::vector<uint32_t> ids;
+      if (rule_id == start) {
+        ids.push_back(static_cast<uint32_t>(end_terminal));
+      }
+      for (size_t i = 0; i < parts.size(); i++) {
+        for (; terminal_pos[i] < parts[i].terminals.size() && parts[i].terminals[terminal_pos[i]].first == rule_id;
+               terminal_pos[i]++) {
+          ids.push_back(parts[i].terminals[terminal_pos[i]].second);
+        }
+        for (; depend_pos[i] < parts[i].depends.size() && parts[i].depends[depend_pos[i]].first == rule_id;
+               depend_pos[i]++) {
+          depends[rule_id].push_back(parts[i].depends[depend_pos[i]].second);
+        }
+      }
+      std::sort(ids.begin(), ids.end());
+      ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+      own[rule_id] = terminal_set(terminal_names.size(), std::move(ids));
+    }
+  });
+  parts.clear();
+  propagate(own, depends, follow);
 }
 
-template<typename T>
-bool intersects(const std::set<T> &a, const std::set<T> &b) {
-  if (a.size() > b.size()) {
-    return intersects(b, a);
-  }
-  return std::any_of(a.begin(), a.end(), [&b](const T &value) { return b.find(value) != b.end(); });
-}
-
-void grammar_analyzer::check_ll1() {
-  for (const auto&[non_terminal, cur_rules]: rules) {
-    size_t rule1_i = 0;
-    for (const auto &rule1: cur_rules) {
-      size_t rule2_i = 0;
-      for (const auto &rule2: cur_rules) {
-        if (rule1_i != rule2_i) {
-          std::vector<std::string> intersection;
-          const auto &first1 = get_first(rule1);
-          const auto &first2 = get_first(rule2);
-          if (intersects(first1, first2) ||
-            (first1.find("EPS") != first1.end() && intersects(follow[non_terminal], first2))) {
-            throw std::runtime_error("Parser can not be generated because of rules:\n" +
-              rule_to_string(non_terminal, rule1) + "\n" +
-              rule_to_string(non_terminal, rule2));
+/**
+ * Rules of a strongly connected component depend on each other, so all of them share the union of their sets
+ * and of the sets of the components they depend on. Components are solved in the topological order,
+ * the ones not depending on each other in parallel, so the result is the same as of the serial analysis.
+ * A component adds to the node of its largest dependency the terminals of its rules and of its other
+ * dependencies missing from that node.
+ */
+void grammar_analyzer::propagate(std::vector<terminal_set> &own, const std::vector<std::vector<size_t>> &depends,
+                                 rule_sets &sets) const {
+  std::vector<size_t> component;
+  size_t count = find_components(depends, component);
+  std::vector<std::vector<size_t>> members(count);
+  for (size_t rule_id = 0; rule_id < depends.size(); rule_id++) {
+    members[component[rule_id]].push_back(rule_id);
+  }
+  sets.min_node.assign(terminal_names.size(), NONE);
+  for (size_t rule_id = 0; rule_id < depends.size(); rule_id++) {
+    own[rule_id].for_each([&](size_t terminal) {
+      sets.min_node[terminal] = std::min(sets.min_node[terminal], component[rule_id]);
+    });
+  }
+  sets.base.assign(count, NONE);
+  sets.sizes.assign(count, 0);
+  sets.added.assign(count, terminal_set());
+
+  std::vector<size_t> node(count, NONE);
+  auto solve = [&](size_t cur) {
+    std::vector<size_t> dependencies;
+    for (size_t rule_id: members[cur]) {
+      for (size_t dependency: depends[rule_id]) {
+        if (component[dependency] != cur && node[component[dependency]] != NONE) {
+          dependencies.push_back(node[component[dependency]]);
+        }
+      }
+    }
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+    size_t base = NONE;
+    for (size_t dependency: dependencies) {
+      if (base == NONE || sets.sizes[dependency] > sets.sizes[base]) {
+        base = dependency;
+      }
+    }
+
+    std::vector<uint32_t> ids;
+    auto add = [&](size_t terminal) {
+      if (!sets.node_contains(base, terminal)) {
+        ids.push_back(static_cast<uint32_t>(terminal));
+      }
+    };
+    for (size_t rule_id: members[cur]) {
+      own[rule_id].for_each(add);
+      own[rule_id] = terminal_set();
+    }
+    for (size_t dependency: dependencies) {
+      for (size_t cur_node = dependency; cur_node != base && cur_node != NONE; cur_node = sets.base[cur_node]) {
+        sets.added[cur_node].for_each(add);
+      }
+    }
+    if (ids.empty()) {
+      node[cur] = base;
+      return;
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    node[cur] = cur;
+    sets.base[cur] = base;
+    sets.sizes[cur] = ids.size() + (base == NONE ? 0 : sets.sizes[base]);
+    sets.added[cur] = terminal_set(terminal_names.size(), std::move(ids));
+  };
+
+  if (threads < 2) {
+    for (size_t cur = 0; cur < count; cur++) {
+      solve(cur);
+    }
+  } else {
+    std::vector<size_t> batch;
+    std::vector<std::vector<size_t>> batches = make_batches(depends, component, members, batch);
+    task_graph graph(batches.size());
+    std::vector<std::pair<size_t, size_t>> edges;
+    for (size_t cur_batch = 0; cur_batch < batches.size(); cur_batch++) {
+      for (size_t cur: batches[cur_batch]) {
+        for (size_t rule_id: members[cur]) {
+          for (size_t dependency: depends[rule_id]) {
+            if (batch[component[dependency]] != cur_batch) {
+              edges.emplace_back(cur_batch, batch[component[dependency]]);
+            }
           }
         }
-        rule2_i++;
       }
-      rule1_i++;
     }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    for (const auto&[cur_batch, dependency]: edges) {
+      graph.add_dependency(cur_batch, dependency);
+    }
+    graph.run([&](size_t cur_batch) {
+      for (size_t cur: batches[cur_batch]) {
+        solve(cur);
+      }
+    }, threads);
   }
+  sets.rule_node.resize(depends.size());
+  for (size_t rule_id = 0; rule_id < depends.size(); rule_id++) {
+    sets.rule_node[rule_id] = node[component[rule_id]];
+  }
+}
+
+std::set<std::string> grammar_analyzer::get_follow(const std::string &non_term) const {
+  std::set<std::string> res;
+  auto rule_id = rule_ids.find(non_term);
+  if (rule_id != rule_ids.end()) {
+    follow.for_each(rule_id->second, [&](size_t terminal) {
+      res.insert(terminal_names[terminal]);
+    });
+  }
+  return res;
+}
+
+std::string grammar_analyzer::rule_to_string(size_t rule_id, size_t alternative) const {
+  std::string s = rule_names[rule_id] + " :";
+  for (symbol_t symbol: rules[rule_id][alternative]) {
+    if (symbol != end_terminal) {
+      s += " " + (is_terminal(symbol) ? terminal_names[symbol] : rule_names[symbol - terminal_names.size()]);
+    }
+  }
+  return s;
 }
 
-std::set<std::string> grammar_analyzer::get_follow(const std::string &non_term) {
-  return follow[non_term];
+bool grammar_analyzer::predict_set::contains(size_t terminal) const {
+  return std::find(terminals.begin(), terminals.end(), terminal) != terminals.end()
+    || std::any_of(sets.begin(), sets.end(), [terminal](const std::pair<const rule_sets *, size_t> &set) {
+      return set.first->contains(set.second, terminal);
+    });
+}
+
+/**
+ * Predict set of an alternative is the union of FIRST of its nullable prefix (and of FOLLOW of the rule,
+ * if the whole alternative is nullable), it is not built. Terminals of every alternative but the largest one
+ * are enumerated: a terminal predicting two of them is a conflict, and so is a terminal in the largest one.
+ * A conflict is the pair of the alternative and the first alternative before it sharing a terminal with it,
+ * or the first nullable one if both are nullable, and the first conflict of the first rule is reported.
+ * Blocks of rules are checked in parallel, so the error is the same as of the serial check.
+ */
+void grammar_analyzer::check_ll1() const {
+  std::mutex conflict_mutex;
+  size_t conflict_rule = NONE, conflict_first = NONE, conflict_second = NONE;
+  for_each_block([&](size_t, size_t begin, size_t end) {
+    std::vector<size_t> owner_rule(terminal_names.size(), NONE), owner(terminal_names.size(), NONE);
+    std::vector<predict_set> predicts;
+    for (size_t rule_id = begin; rule_id < end; rule_id++) {
+      const auto &alternatives = rules[rule_id];
+      if (predicts.size() < alternatives.size()) {
+        predicts.resize(alternatives.size());
+      }
+      // Conflict as the pair of the later and the earlier alternative, the least one is reported
+      std::pair<size_t, size_t> conflict(NONE, NONE);
+      size_t nullable_alternative = NONE, largest = 0;
+      for (size_t alternative = 0; alternative < alternatives.size(); alternative++) {
+        predict_set &predict = predicts[alternative];
+        predict.terminals.clear();
+        predict.sets.clear();
+        predict.size = 0;
+        bool alternative_nullable = true;
+        for (symbol_t symbol: alternatives[alternative]) {
+          if (!is_terminal(symbol)) {
+            predict.sets.emplace_back(&first, symbol - terminal_names.size());
+            predict.size += first.size(symbol - terminal_names.size());
+          } else if (symbol != eps_terminal) {
+            predict.terminals.push_back(symbol);
+            predict.size++;
+          }
+          if (!symbol_nullable(symbol)) {
+            alternative_nullable = false;
+            break;
+          }
+        }
+        if (alternative_nullable) {
+          predict.sets.emplace_back(&follow, rule_id);
+          predict.size += follow.size(rule_id);
+          if (nullable_alternative == NONE) {
+            nullable_alternative = alternative;
+          } else {
+            conflict = std::min(conflict, std::make_pair(alternative, nullable_alternative));
+          }
+        }
+        if (predict.size > predicts[largest].size) {
+          largest = alternative;
+        }
+      }
+      for (size_t alternative = 0; alternative < alternatives.size(); alternative++) {
+        if (alternative == largest) {
+          continue;
+        }
+        predicts[alternative].for_each([&](size_t terminal) {
+          if (owner_rule[terminal] != rule_id) {
+            owner_rule[terminal] = rule_id;
+            owner[terminal] = alternative;
+          } else if (owner[terminal] != alternative) {
+            conflict = std::min(conflict, std::make_pair(alternative, owner[terminal]));
+          }
+          if (predicts[largest].contains(terminal)) {
+            conflict = std::min(conflict, std::make_pair(std::max(alternative, largest), std::min(alternative, largest)));
+          }
+        });
+      }
+      if (conflict.first != NONE) {
+        std::lock_guard<std::mutex> lock(conflict_mutex);
+        if (rule_id < conflict_rule) {
+          conflict_rule = rule_id;
+          conflict_first = conflict.second;
+          conflict_second = conflict.first;
+        }
+        return;
+      }
+    }
+  });
+  if (conflict_rule != NONE) {
+    throw std::runtime_error("Parser can not be generated because of rules:\n" +
+      rule_to_string(conflict_rule, conflict_first) + "\n" +
+      rule_to_string(conflict_rule, conflict_second));
+  }
 }
@@ -5,31 +5,156 @@
 #ifndef PARSER_GENERATOR_GRAMMAR_GRAMMAR_ANALYZER_H_
 #define PARSER_GENERATOR_GRAMMAR_GRAMMAR_ANALYZER_H_
 
+#include <cstdint>
 #include <iostream>
-#include <map>
-#include <vector>
-#include <string>
 #include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "../parser/rule_cfg.h"
 
+/**
+ * FIRST and FOLLOW sets of the grammar. Symbols are interned to dense ids, terminals and rules separately,
+ * so the sets are sets of terminal ids. The sets are propagated over strongly connected components
+ * of the graph of dependencies between rules, all rules of a component share one set, which stores only
+ * the terminals missing from the set of its largest dependency. For large grammars independent batches
+ * of components are solved in parallel, and FOLLOW is collected and the rules are checked for LL(1) conflicts
+ * by blocks of rules in parallel.
+ * END and EPS are terminals which may be skipped, as in FIRST sets returned by get_first.
+ */
 class grammar_analyzer {
  public:
-  grammar_analyzer(const std::vector<rule_cfg>& rules_cfg, const std::string& start);
+  // Large grammars are analyzed by up to threads threads, each of them gets several thousands of symbols
+  grammar_analyzer(const std::vector<rule_cfg> &rules_cfg, const std::string &start,
+                   size_t threads = std::thread::hardware_concurrency());
 
-  std::set<std::string> get_first(const std::vector<std::string> &rule);
-  std::set<std::string> get_follow(const std::string &non_term);
+  std::set<std::string> get_first(const std::vector<std::string> &rule) const;
+  std::set<std::string> get_follow(const std::string &non_term) const;
 
  private:
-  std::map<std::string, std::vector<std::vector<std::string>>> rules;
-  std::set<std::string> terminals;
-  std::map<std::vector<std::string>, std::set<std::string>> first;
-  std::map<std::string, std::set<std::string>> follow;
-  std::string start;
+  /**
+   * Set of terminal ids: a sorted vector of ids while it is small, a bitset over all terminals
+   * once it holds more than 1/32 of them, so a set takes the memory of the smaller of them
+   */
+  class terminal_set {
+   public:
+    explicit terminal_set(size_t universe = 0);
+    // Set of the sorted distinct ids
+    terminal_set(size_t universe, std::vector<uint32_t> &&ids);
+
+    void insert(size_t terminal);
+    // Returns whether anything was added
+    bool merge(const terminal_set &other);
+    bool contains(size_t terminal) const;
+    size_t size() const;
+    void clear();
+
+    template<typename F>
+    void for_each(F f) const {
+      if (!dense) {
+        for (uint32_t terminal: ids) {
+          f(terminal);
+        }
+        return;
+      }
+      for (size_t word = 0; word < words.size(); word++) {
+        for (uint64_t bits = words[word]; bits != 0; bits &= bits - 1) {
+          f(word * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+        }
+      }
+    }
+
+   private:
+    size_t universe = 0, count = 0;
+    bool dense = false;
+    std::vector<uint32_t> ids;
+    std::vector<uint64_t> words;
+
+    void make_dense();
+  };
+
+  /**
+   * FIRST or FOLLOW sets of the rules. The set of a component is a node: the terminals it adds
+   * to the node of its largest dependency, or that node itself if it adds nothing. So a chain of rules
+   * adding a terminal each takes memory linear in its length instead of quadratic.
+   */
+  class rule_sets {
+   public:
+    size_t size(size_t rule_id) const;
+    bool contains(size_t rule_id, size_t terminal) const;
+
+    template<typename F>
+    void for_each(size_t rule_id, F f) const {
+      for (size_t node = rule_node[rule_id]; node != NONE; node = base[node]) {
+        added[node].for_each(f);
+      }
+    }
+
+   private:
+    friend class grammar_analyzer;
+    static const size_t NONE = static_cast<size_t>(-1);
+
+    // Node of the component of every rule; nodes are numbered as components, after the nodes they are based on
+    std::vector<size_t> rule_node, base, sizes;
+    std::vector<terminal_set> added;
+    // The first node which may have the terminal: the first component having it before propagation
+    std::vector<size_t> min_node;
+
+    bool node_contains(size_t node, size_t terminal) const;
+  };
+
+  // Predict set of an alternative as the union of its terminals and of the sets of its rules, terminals may repeat
+  struct predict_set {
+    std::vector<size_t> terminals;
+    std::vector<std::pair<const rule_sets *, size_t>> sets;
+    // Upper bound of the number of terminals
+    size_t size = 0;
+
+    bool contains(size_t terminal) const;
+
+    template<typename F>
+    void for_each(F f) const {
+      for (size_t terminal: terminals) {
+        f(terminal);
+      }
+      for (const auto&[set, rule_id]: sets) {
+        set->for_each(rule_id, f);
+      }
+    }
+  };
+
+  // Symbol of an alternative: terminal id, or the number of terminals plus rule id
+  using symbol_t = size_t;
+
+  std::vector<std::string> terminal_names, rule_names;
+  std::unordered_map<std::string, size_t> terminal_ids, rule_ids;
+  size_t start = 0, end_terminal = 0, eps_terminal = 0, threads = 1;
+  // Alternatives of every rule in the order of declaration
+  std::vector<std::vector<std::vector<symbol_t>>> rules;
+  std::vector<bool> nullable;
+  rule_sets first, follow;
+
+  symbol_t intern(const std::string &symbol) const;
+  bool is_terminal(symbol_t symbol) const;
+  bool symbol_nullable(symbol_t symbol) const;
+  // Adds FIRST of the symbol to the set, returns whether the symbol may be empty
+  bool add_first(symbol_t symbol, terminal_set &set) const;
+
+  // Calls f(block, begin, end) for blocks of rules covering all rules, in parallel for large grammars
+  template<typename F>
+  void for_each_block(F f) const;
+  size_t blocks_count() const;
 
+  void init_nullable();
   void init_first();
   void init_follow();
+  // Builds the sets of the rules including the own sets of the rules they depend on, the own sets are freed
+  void propagate(std::vector<terminal_set> &own, const std::vector<std::vector<size_t>> &depends,
+                 rule_sets &sets) const;
 
-  void check_ll1();
+  void check_ll1() const;
+  std::string rule_to_string(size_t rule_id, size_t alternative) const;
 };
 
 #endif //PARSER_GENERATOR_GRAMMAR_GRAMMAR_ANALYZER_H_
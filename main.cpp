@@ -1,7 +1,12 @@
 #include <iostream>
 #include <unordered_map>
 #include <algorithm>
+#include "generators/bench_generator.h"
+#include "generators/generator_options.h"
 #include "generators/lexer_generator.h"
+#include "generators/profile_generator.h"
+#include "generators/table_generator.h"
+#include "generators/tree_generator.h"
 #include "grammar/grammar_analyzer.h"
 #include "parser/fun.h"
 #include "parser/fun_parser.h"
@@ -10,8 +15,8 @@
 #include "utils/utils.h"
 
 int main(int argc, char **argv) {
-  if (argc != 3) {
-    std::cerr << "Expected arguments: <file with grammar> <folder to place parser>" << std::endl;
+  if (argc < 3) {
+    std::cerr << "Expected arguments: <file with grammar> <folder to place parser> [options]" << std::endl;
     return 1;
   }
 
@@ -19,6 +24,8 @@ int main(int argc, char **argv) {
   const std::string folder_path(argv[2]);
 
   try {
+    const generator_options options = generator_options::parse(std::vector<std::string>(argv + 3, argv + argc));
+
     std::ifstream in(grammar_file);
     if (!in.is_open()) {
       throw std::runtime_error("File " + grammar_file + " can not be opened.");
@@ -26,7 +33,7 @@ int main(int argc, char **argv) {
     in.exceptions(std::ios_base::failbit);
 
     std::string line;
-    lexer_generator lexer_generator_;
+    lexer_generator lexer_generator_(options);
     std::unordered_map<std::string, rule> rules;
     std::unordered_map<std::string, fun> funs;
     std::vector<rule_cfg> rules_cfg;
@@ -52,7 +59,7 @@ int main(int argc, char **argv) {
         rules_cfg.push_back(cur_rule.generate_cfg());
       } else if (std::isalpha(line[0]) && std::isupper(line[0])) {
         auto[name, regex] = parse_regex(line);
-        lexer_generator_.add_regex(name, escape(regex));
+        lexer_generator_.add_regex(name, regex);
       } else {
         throw std::runtime_error("Unexpected first char in:\n" + line);
       }
@@ -84,6 +91,17 @@ int main(int argc, char **argv) {
       }
     }
 
+    if (!options.pgo.empty()) {
+      auto frequencies = profile_generator::read_frequencies(options.pgo);
+      for (auto&[rule_name, cur_rule]: rules) {
+        auto it = frequencies.find(rule_name);
+        // Rules not called in the profiled runs are cold as a whole
+        cur_rule.set_frequencies(it == frequencies.end()
+                                 ? std::vector<uint64_t>(cur_rule.get_alternatives_count())
+                                 : std::move(it->second));
+      }
+    }
+
     std::unordered_map<std::string, std::string> constructors;
     for (const auto&[rule_name, cur_rule]: rules) {
       constructors.emplace(rule_name, cur_rule.generate_constructor());
@@ -102,35 +120,83 @@ int main(int argc, char **argv) {
     result_cpp.exceptions(std::ios_base::failbit);
     result_h.exceptions(std::ios_base::failbit);
 
+    if (options.constexpr_parser) {
+      result_h << "#pragma once" << std::endl;
+    }
     result_h
       << "#include <bits/stdc++.h>" << std::endl
+      << "#include <fcntl.h>" << std::endl
+      << "#include <sys/mman.h>" << std::endl
+      << "#include <sys/stat.h>" << std::endl
+      << "#include <unistd.h>" << std::endl
       << std::endl
-      << "struct base_node {" << std::endl
-      << "\tvirtual void visit() = 0;" << std::endl
-      << "};" << std::endl
-      << std::endl
-      << "struct text_node : public base_node {" << std::endl
-      << "\ttext_node(std::string text_) : text(std::move(text_)) {}" << std::endl
-      << std::endl
-      << "\tvoid visit() override {}" << std::endl
-      << std::endl
-      << "\tstd::string text;" << std::endl
-      << "};" << std::endl
-      << std::endl
-      << "struct inner_node : public base_node {" << std::endl
-      << "\tvoid add_child(const std::shared_ptr<base_node> &node) {" << std::endl
-      << "\t\tchildren.push_back(node);" << std::endl
-      << "\t}" << std::endl
-      << std::endl
-      << "\tvirtual void parse() = 0;" << std::endl
-      << std::endl
-      << "\tstd::vector<std::shared_ptr<base_node>> children;" << std::endl
-      << "};" << std::endl;
-
-    result_h << lexer_generator_.generate() << std::endl << std::endl;
+      << lexer_generator_.generate() << std::endl;
+    if (options.recover) {
+      result_h
+        << "// Syntax error found by the parser, position is the offset of the unexpected token" << std::endl
+        << "struct parse_error {" << std::endl
+        << "\tsize_t position;" << std::endl
+        << "\tstd::string message;" << std::endl
+        << "};" << std::endl
+        << std::endl;
+    }
+    if (options.no_exceptions) {
+      result_h
+        << "enum class PARSE_ERROR : uint8_t {" << std::endl
+        << "\tNONE," << std::endl
+        << "\tUNEXPECTED_TOKEN," << std::endl
+        << "\tUNEXPECTED_CHARACTER," << std::endl
+        << "\tEOF_EXPECTED," << std::endl
+        << "\tREAD_FAILED" << std::endl
+        << "};" << std::endl
+        << std::endl
+        << "// The first error of the parse, the message is built only when it is asked for" << std::endl
+        << "struct parse_status {" << std::endl
+        << "\tPARSE_ERROR code = PARSE_ERROR::NONE;" << std::endl
+        << "\tsize_t position = 0;" << std::endl
+        << "\ttext_t found;" << std::endl
+        << "\tTOKEN_TYPE expected = TOKEN_TYPE::END;" << std::endl
+        << std::endl
+        << "\tPARSE_ERROR fail(PARSE_ERROR code_, size_t position_, text_t found_, TOKEN_TYPE expected_) noexcept {" << std::endl
+        << "\t\tcode = code_;" << std::endl
+        << "\t\tposition = position_;" << std::endl
+        << "\t\tfound = std::move(found_);" << std::endl
+        << "\t\texpected = expected_;" << std::endl
+        << "\t\treturn code;" << std::endl
+        << "\t}" << std::endl
+        << std::endl
+        << "\texplicit operator bool() const noexcept {" << std::endl
+        << "\t\treturn code == PARSE_ERROR::NONE;" << std::endl
+        << "\t}" << std::endl
+        << std::endl
+        << "\tstd::string message() const;" << std::endl
+        << "};" << std::endl
+        << std::endl;
+    }
+    std::vector<std::string> rule_names;
+    for (const auto &rule_entry: rules) {
+      rule_names.push_back(rule_entry.first);
+    }
+    std::sort(rule_names.begin(), rule_names.end());
+    const tree_generator tree_generator_(options, rule_names);
+    const table_generator table_generator_(options, rules, rule_names);
+    const profile_generator profile_generator_(options, rules);
+    if (options.profile) {
+      result_h << profile_generator_.generate_declaration();
+    }
+    if (!options.actions_only || options.flat) {
+      result_h << tree_generator_.generate();
+    }
+    if (options.table) {
+      result_h << table_generator_.generate_declaration();
+    }
 
-    result_cpp << "#include \"gen.h\"" << std::endl
-               << "lexer lexer_(\"\");" << std::endl;
+    // With --constexpr the whole parser is defined in the header, gen.cpp contains only main
+    std::ofstream &result_defs = options.constexpr_parser ? result_h : result_cpp;
+    result_cpp << "#include \"gen.h\"" << std::endl;
+    if (options.profile) {
+      result_cpp << profile_generator_.generate_implementation();
+    }
 
     std::unordered_map<std::string, std::set<std::string>> exported_vars;
     for (const auto&[rule_name, cur_rule]: rules) {
@@ -140,37 +206,490 @@ int main(int argc, char **argv) {
       }
       exported_vars.emplace(rule_name, exported_vars_names);
     }
+    // Without the tree nothing but the parent sees variables of the child, so only the ones it reads are passed up
+    if (options.actions_only && !options.flat) {
+      for (auto&[rule_name, exported_vars_names]: exported_vars) {
+        if (rule_name == start) {
+          continue;
+        }
+        std::set<std::string> read_vars;
+        for (const auto &parent: rules) {
+          for (const auto&[prefix, assign_rule]: parent.second.get_assigns()) {
+            for (const auto &var_name: exported_vars_names) {
+              if (assign_rule == rule_name && parent.second.reads_var(prefix + "_" + var_name, constructors)) {
+                read_vars.insert(var_name);
+              }
+            }
+          }
+        }
+        exported_vars_names = std::move(read_vars);
+      }
+    }
 
+    std::vector<std::string> rules_cpp_code;
     for (const auto&[rule_name, cur_rule]: rules) {
-      auto[header_code, cpp_code] = cur_rule.generate_class(constructors, exported_vars, analyzer);
+      auto[header_code, cpp_code] = cur_rule.generate_class(constructors, exported_vars, analyzer, lexer_generator_, options);
       result_h << header_code << std::endl << std::endl;
+      rules_cpp_code.push_back(cpp_code);
+    }
+    if (options.flat) {
+      result_h << tree_generator_.generate_flat_tree();
+    } else if (!options.actions_only) {
+      result_h << tree_generator_.generate_visitor();
+    }
+    for (const auto &cpp_code: rules_cpp_code) {
+      result_defs << cpp_code << std::endl;
+    }
+    if (options.table) {
+      auto[header_code, cpp_code] = table_generator_.generate(analyzer, lexer_generator_);
+      result_h << header_code;
       result_cpp << cpp_code << std::endl;
     }
 
-    result_cpp
-      << "std::shared_ptr<" << start << "_node> parse(std::string text) {" << std::endl
-      << "\tlexer_ = lexer(text);" << std::endl
-      << "\tauto node = std::make_shared<" << start << "_node>();" << std::endl
-      << "\tnode->parse();" << std::endl
-      << "\tif (lexer_.next().first != TOKEN_TYPE::END) {" << std::endl
-      << "\t\tthrow std::runtime_error(\"EOF expected\");" << std::endl
+    // Type of the parse result followed by a space or by '*'
+    std::string start_ptr = "std::shared_ptr<" + start + "_node> ";
+    if (options.flat) {
+      start_ptr = "flat_tree ";
+    } else if (options.actions_only) {
+      start_ptr = start + "_node ";
+    } else if (options.arena) {
+      start_ptr = start + "_node *";
+    }
+    const std::string text_type = options.spans ? "std::string_view" : "std::string";
+    std::string node_access = options.actions_only ? "node." : "node->";
+    if (options.flat) {
+      node_access = "node.get_" + start + "(0).";
+    }
+    // State of the parse passed through all overloads: the arena of nodes and the list of syntax errors
+    std::string state_param, state_arg;
+    if (options.arena) {
+      state_param += ", node_arena &arena";
+      state_arg += ", arena";
+    }
+    if (options.recover) {
+      state_param += ", std::vector<parse_error> &errors";
+      state_arg += ", errors";
+    }
+    if (options.no_exceptions) {
+      state_param += ", parse_status &status";
+      state_arg += ", status";
+    }
+    if (!options.constexpr_parser) {
+      result_h << start_ptr << "parse(lexer input" << state_param << ");" << std::endl
+               << start_ptr << "parse(" << text_type << " text" << state_param << ");" << std::endl
+               << start_ptr << "parse(const mapped_file &file" << state_param << ");" << std::endl;
+      if (!options.spans) {
+        result_h << start_ptr << "parse(std::istream &in" << state_param << ");" << std::endl
+                 << start_ptr << "parse_fd(int fd" << state_param << ");" << std::endl;
+      }
+    }
+    // Trees from the arena are released together and errors are kept per parse,
+    // so the batch parse is generated only without them
+    const std::string results_type = "std::vector<" + start_ptr.substr(0, start_ptr.size() - 1) + ">";
+    const std::string threads_default = " = std::thread::hardware_concurrency()";
+    if (!options.constexpr_parser && !options.arena && !options.recover && !options.no_exceptions) {
+      result_h << results_type << " parse_many(const std::vector<std::string_view> &inputs, size_t threads"
+               << threads_default << ");" << std::endl;
+    }
+    // The tree before the edit is dropped before reparsing, so after an error the next edit parses everything
+    if (options.incremental) {
+      const std::string tree_ptr = "std::shared_ptr<" + start + "_node>";
+      result_h
+        << std::endl
+        << "// Keeps the input, its tokens and its tree, after an edit only the damaged part of the tree is parsed" << std::endl
+        << "class incremental_parser {" << std::endl
+        << " public:" << std::endl
+        << "\texplicit incremental_parser(std::string text);" << std::endl
+        << std::endl
+        << "\tconst " << tree_ptr << " &tree() const {" << std::endl
+        << "\t\treturn tree_;" << std::endl
+        << "\t}" << std::endl
+        << std::endl
+        << "\tstd::string_view text() const {" << std::endl
+        << "\t\treturn lexer_.text();" << std::endl
+        << "\t}" << std::endl
+        << std::endl
+        << "\t// Replaces removed bytes at offset by inserted ones, throws if the new input can not be parsed" << std::endl
+        << "\tconst " << tree_ptr << " &edit(size_t offset, size_t removed, const std::string &inserted);" << std::endl
+        << std::endl
+        << " private:" << std::endl
+        << "\tvoid reparse(const reparse_window &window);" << std::endl
+        << std::endl
+        << "\tlexer lexer_;" << std::endl
+        << "\t" << tree_ptr << " tree_;" << std::endl
+        << "};" << std::endl;
+      result_cpp
+        << "incremental_parser::incremental_parser(std::string text)" << std::endl
+        << "\t: lexer_(std::move(text)) {" << std::endl
+        << "\treparse({});" << std::endl
+        << "}" << std::endl
+        << std::endl
+        << "const " << tree_ptr << " &incremental_parser::edit(size_t offset, size_t removed, const std::string &inserted) {" << std::endl
+        << "\treparse(lexer_.relex(offset, removed, inserted));" << std::endl
+        << "\treturn tree_;" << std::endl
+        << "}" << std::endl
+        << std::endl
+        << "void incremental_parser::reparse(const reparse_window &window) {" << std::endl
+        << "\t" << tree_ptr << " old_tree = std::move(tree_);" << std::endl
+        << "\told_children old{window, old_tree.get()};" << std::endl
+        << "\tauto node = std::make_shared<" << start << "_node>();" << std::endl
+        << "\tnode->parse(lexer_, old);" << std::endl
+        << "\tif (lexer_.next().first != TOKEN_TYPE::END) {" << std::endl
+        << "\t\tthrow std::runtime_error(\"EOF expected\");" << std::endl
+        << "\t}" << std::endl
+        << "\ttree_ = node;" << std::endl
+        << "}" << std::endl
+        << std::endl;
+    }
+    // The loop of the table parser is resumed by every chunk, tokens are lexed only when they are complete
+    if (options.push) {
+      result_h
+        << std::endl
+        << "// Parses the input fed by chunks as they arrive, memory is bounded by the nesting depth and the longest token" << std::endl
+        << "class push_parser {" << std::endl
+        << " public:" << std::endl
+        << "\texplicit push_parser(parse_events &events);" << std::endl
+        << std::endl
+        << "\t// Parses all tokens completed by the chunk, throws on errors" << std::endl
+        << "\tvoid feed(std::string_view chunk);" << std::endl
+        << std::endl
+        << "\t// Parses the rest of the input and returns the value of the start rule" << std::endl
+        << "\t" << start_ptr << "finish();" << std::endl
+        << std::endl
+        << " private:" << std::endl
+        << "\tlexer lexer_;" << std::endl
+        << "\ttable_stack stack_;" << std::endl
+        << "};" << std::endl;
+      result_cpp
+        << "push_parser::push_parser(parse_events &events) {" << std::endl
+        << "\tstack_.events = &events;" << std::endl
+        << "\tevents.enter(NODE_KIND::" << start << ");" << std::endl
+        << "\tstack_." << start << "_nodes.emplace_back();" << std::endl
+        << "\tstack_.states.push_back(STATE_" << start << ");" << std::endl
+        << "}" << std::endl
+        << std::endl
+        << "void push_parser::feed(std::string_view chunk) {" << std::endl
+        << "\tlexer_.feed(chunk);" << std::endl
+        << "\ttable_run(lexer_, stack_);" << std::endl
+        << "}" << std::endl
+        << std::endl
+        << start_ptr << "push_parser::finish() {" << std::endl
+        << "\tlexer_.finish();" << std::endl
+        << "\ttable_run(lexer_, stack_);" << std::endl
+        << "\tlexer_.ready(1);" << std::endl
+        << "\tif (lexer_.next().first != TOKEN_TYPE::END) {" << std::endl
+        << "\t\tthrow std::runtime_error(\"EOF expected\");" << std::endl
+        << "\t}" << std::endl
+        << "\tstack_.events->exit(NODE_KIND::" << start << ");" << std::endl
+        << "\treturn std::move(stack_." << start << "_nodes.back());" << std::endl
+        << "}" << std::endl
+        << std::endl;
+    }
+    std::string result = "node";
+    // Without exceptions the first error of the rules is returned, the lexer only marks where it has failed
+    const std::string error_code = options.no_exceptions ? "PARSE_ERROR error = " : "";
+    std::string end_check = "\tif (input.next().first != TOKEN_TYPE::END) {\n";
+    if (options.no_exceptions) {
+      end_check =
+        "\ttoken_t token = error == PARSE_ERROR::NONE ? input.next() : token_t();\n"
+        "\tif (input.failed()) {\n"
+        "\t\tstatus.fail(PARSE_ERROR::UNEXPECTED_CHARACTER, input.error_position(), {}, TOKEN_TYPE::END);\n"
+        "\t\treturn {};\n"
+        "\t}\n"
+        "\tif (error != PARSE_ERROR::NONE) {\n"
+        "\t\treturn {};\n"
+        "\t}\n"
+        "\tif (token.first != TOKEN_TYPE::END) {\n";
+    }
+    // With --recover the input left after the start rule is parsed again from a token which may start it,
+    // only to report its errors, so the loop ends at the end of the input
+    std::string parse_rest;
+    if (options.recover) {
+      end_check = "\twhile (input.next().first != TOKEN_TYPE::END) {\n";
+      result_defs << rules.at(start).generate_resume(analyzer, lexer_generator_) << std::endl;
+    }
+    if (options.no_exceptions) {
+      result_cpp
+        << "std::string parse_status::message() const {" << std::endl
+        << "\tswitch (code) {" << std::endl
+        << "\t\tcase PARSE_ERROR::NONE:" << std::endl
+        << "\t\t\treturn \"\";" << std::endl
+        << "\t\tcase PARSE_ERROR::UNEXPECTED_TOKEN: {" << std::endl
+        << "\t\t\tstd::string description = lexer::token_descriptions[static_cast<size_t>(expected)];" << std::endl
+        << "\t\t\tif (description[0] != '\\'') {" << std::endl
+        << "\t\t\t\treturn \"Found unexpected token, expected \" + description;" << std::endl
+        << "\t\t\t}" << std::endl
+        << "\t\t\treturn \"Found token '\" + std::string(found) + \"' but expected \" + description;" << std::endl
+        << "\t\t}" << std::endl
+        << "\t\tcase PARSE_ERROR::UNEXPECTED_CHARACTER:" << std::endl
+        << "\t\t\treturn \"Unexpected token\";" << std::endl
+        << "\t\tcase PARSE_ERROR::EOF_EXPECTED:" << std::endl
+        << "\t\t\treturn \"EOF expected\";" << std::endl
+        << "\t\tcase PARSE_ERROR::READ_FAILED:" << std::endl
+        << "\t\t\treturn \"Failed to read input\";" << std::endl
+        << "\t}" << std::endl
+        << "\treturn \"\";" << std::endl
+        << "}" << std::endl
+        << std::endl;
+    }
+    if (options.table) {
+      // The start rule is the bottom of the stack, it is left there when the loop ends
+      result_cpp
+        << start_ptr << "parse(lexer input) {" << std::endl
+        << "\ttable_stack stack_;" << std::endl;
+      if (options.flat) {
+        result = "tree";
+        result_cpp
+          << "\tflat_tree tree;" << std::endl
+          << "\tsize_t index = tree.open(NODE_KIND::" << start << ", input.position());" << std::endl;
+      }
+      result_cpp
+        << "\tstack_." << start << "_nodes.emplace_back();" << std::endl
+        << "\tstack_.states.push_back(STATE_" << start << ");" << std::endl
+        << "\ttable_run(input" << (options.flat ? ", tree" : "") << ", stack_);" << std::endl;
+      if (options.flat) {
+        result_cpp << "\ttree.close(index, input.position(), tree." << start << "_attrs, std::move(stack_." << start << "_nodes.back()));" << std::endl;
+      } else {
+        result_cpp << "\tauto node = std::move(stack_." << start << "_nodes.back());" << std::endl;
+      }
+      if (options.push) {
+        // The push lexer lexes only the tokens the loop waits for, the last step may leave none ahead
+        result_cpp << "\tinput.ready(1);" << std::endl;
+      }
+      result_cpp << "\tif (input.next().first != TOKEN_TYPE::END) {" << std::endl;
+    } else if (options.flat) {
+      result = "tree";
+      result_cpp
+        << start_ptr << "parse(lexer input" << state_param << ") {" << std::endl
+        << "\tflat_tree tree;" << std::endl
+        << "\tauto node = " << start << "_node();" << std::endl
+        << "\tsize_t index = tree.open(NODE_KIND::" << start << ", input.position());" << std::endl
+        << "\t" << error_code << "node.parse(input, tree" << state_arg << ");" << std::endl
+        << "\ttree.close(index, input.position(), tree." << start << "_attrs, std::move(node));" << std::endl
+        << end_check;
+      parse_rest =
+        "\t\tflat_tree rest_tree;\n"
+        "\t\tauto rest = " + start + "_node();\n"
+        "\t\trest_tree.open(NODE_KIND::" + start + ", input.position());\n"
+        "\t\trest.parse(input, rest_tree" + state_arg + ");\n";
+    } else {
+      result_defs << (options.constexpr_parser ? "constexpr " : "") << start_ptr << "parse(lexer input" << state_param << ") {" << std::endl;
+      std::string make_node = start + "_node()";
+      if (options.arena) {
+        make_node = "arena.make<" + start + "_node>()";
+      } else if (!options.actions_only) {
+        make_node = "std::make_shared<" + start + "_node>()";
+      }
+      result_defs << "\tauto node = " << make_node << ";" << std::endl;
+      if (options.incremental) {
+        result_defs
+          << "\treparse_window window;" << std::endl
+          << "\told_children old{window};" << std::endl;
+      }
+      result_defs
+        << "\t" << error_code << node_access << "parse(input" << state_arg << (options.incremental ? ", old" : "") << ");" << std::endl
+        << end_check;
+      parse_rest =
+        "\t\tauto rest = " + make_node + ";\n"
+        "\t\trest" + (options.actions_only ? "." : "->") + "parse(input" + state_arg + ");\n";
+    }
+    if (options.recover) {
+      result_defs
+        << "\t\tinput.undo();" << std::endl
+        << "\t\t// A rule of the rest may have already stopped at the token with its own error" << std::endl
+        << "\t\tif (errors.empty() || errors.back().position != input.position()) {" << std::endl
+        << "\t\t\terrors.push_back({input.position(), \"EOF expected\"});" << std::endl
+        << "\t\t}" << std::endl
+        << "\t\tif (!resume_" << start << "(input)) {" << std::endl
+        << "\t\t\tbreak;" << std::endl
+        << "\t\t}" << std::endl
+        << parse_rest;
+    } else if (options.no_exceptions) {
+      result_defs
+        << "\t\tinput.undo();" << std::endl
+        << "\t\tstatus.fail(PARSE_ERROR::EOF_EXPECTED, input.position(), std::move(token.second), TOKEN_TYPE::END);" << std::endl
+        << "\t\treturn {};" << std::endl;
+    } else {
+      result_defs << "\t\tthrow std::runtime_error(\"EOF expected\");" << std::endl;
+    }
+    result_defs
       << "\t}" << std::endl
-      << "\treturn node;" << std::endl
+      << "\treturn " << result << ";" << std::endl
+      << "}" << std::endl
+      << std::endl
+      << (options.constexpr_parser ? "constexpr " : "") << start_ptr << "parse(" << text_type << " text" << state_param << ") {" << std::endl
+      << "\treturn parse(lexer(std::move(text))" << state_arg << ");" << std::endl
+      << "}" << std::endl
+      << std::endl
+      << (options.constexpr_parser ? "inline " : "") << start_ptr << "parse(const mapped_file &file" << state_param << ") {" << std::endl
+      << "\treturn parse(lexer(file)" << state_arg << ");" << std::endl
       << "}" << std::endl;
+    if (options.push) {
+      result_cpp
+        << std::endl
+        << start_ptr << "parse(std::istream &in) {" << std::endl
+        << "\tparse_events events;" << std::endl
+        << "\tpush_parser parser(events);" << std::endl
+        << "\tstd::string chunk(1 << 16, '\\0');" << std::endl
+        << "\twhile (in.read(&chunk[0], static_cast<std::streamsize>(chunk.size())) || in.gcount() != 0) {" << std::endl
+        << "\t\tparser.feed(std::string_view(chunk.data(), static_cast<size_t>(in.gcount())));" << std::endl
+        << "\t}" << std::endl
+        << "\treturn parser.finish();" << std::endl
+        << "}" << std::endl
+        << std::endl
+        << start_ptr << "parse_fd(int fd) {" << std::endl
+        << "\tparse_events events;" << std::endl
+        << "\tpush_parser parser(events);" << std::endl
+        << "\tstd::string chunk(1 << 16, '\\0');" << std::endl
+        << "\tssize_t read;" << std::endl
+        << "\twhile ((read = ::read(fd, &chunk[0], chunk.size())) != 0) {" << std::endl
+        << "\t\tif (read == -1 && errno == EINTR) {" << std::endl
+        << "\t\t\tcontinue;" << std::endl
+        << "\t\t}" << std::endl
+        << "\t\tif (read == -1) {" << std::endl
+        << "\t\t\tthrow std::runtime_error(\"Failed to read input\");" << std::endl
+        << "\t\t}" << std::endl
+        << "\t\tparser.feed(std::string_view(chunk.data(), static_cast<size_t>(read)));" << std::endl
+        << "\t}" << std::endl
+        << "\treturn parser.finish();" << std::endl
+        << "}" << std::endl;
+    } else if (!options.spans) {
+      result_cpp
+        << std::endl
+        << start_ptr << "parse(std::istream &in" << state_param << ") {" << std::endl
+        << "\treturn parse(lexer([&in](char *buffer, size_t size) {" << std::endl
+        << "\t\tin.read(buffer, static_cast<std::streamsize>(size));" << std::endl
+        << "\t\treturn static_cast<size_t>(in.gcount());" << std::endl
+        << "\t})" << state_arg << ");" << std::endl
+        << "}" << std::endl
+        << std::endl
+        << start_ptr << "parse_fd(int fd" << state_param << ") {" << std::endl;
+      // Without exceptions the failed read ends the input and the error replaces the result of the parse
+      if (options.no_exceptions) {
+        result_cpp
+          << "\tbool read_failed = false;" << std::endl
+          << "\tauto result = parse(lexer([fd, &read_failed](char *buffer, size_t size) {" << std::endl;
+      } else {
+        result_cpp << "\treturn parse(lexer([fd](char *buffer, size_t size) {" << std::endl;
+      }
+      result_cpp
+        << "\t\tssize_t read;" << std::endl
+        << "\t\twhile ((read = ::read(fd, buffer, size)) == -1 && errno == EINTR) {}" << std::endl
+        << "\t\tif (read == -1) {" << std::endl
+        << (options.no_exceptions
+            ? "\t\t\tread_failed = true;\n\t\t\treturn static_cast<size_t>(0);\n"
+            : "\t\t\tthrow std::runtime_error(\"Failed to read input\");\n")
+        << "\t\t}" << std::endl
+        << "\t\treturn static_cast<size_t>(read);" << std::endl
+        << "\t})" << state_arg << ");" << std::endl;
+      if (options.no_exceptions) {
+        result_cpp
+          << "\tif (read_failed) {" << std::endl
+          << "\t\tstatus.fail(PARSE_ERROR::READ_FAILED, 0, {}, TOKEN_TYPE::END);" << std::endl
+          << "\t\treturn {};" << std::endl
+          << "\t}" << std::endl
+          << "\treturn result;" << std::endl;
+      }
+      result_cpp << "}" << std::endl;
+    }
+    // Inputs are taken by the threads one by one, the first error is rethrown after all inputs are parsed
+    if (!options.arena && !options.recover && !options.no_exceptions) {
+      result_defs
+        << std::endl
+        << (options.constexpr_parser ? "inline " : "") << results_type
+        << " parse_many(const std::vector<std::string_view> &inputs, size_t threads"
+        << (options.constexpr_parser ? threads_default : "") << ") {" << std::endl
+        << "\t" << results_type << " results(inputs.size());" << std::endl
+        << "\tstd::vector<std::exception_ptr> errors(inputs.size());" << std::endl
+        << "\tstd::atomic<size_t> next_input{0};" << std::endl
+        << "\tauto worker = [&]() {" << std::endl
+        << "\t\tfor (size_t i; (i = next_input++) < inputs.size();) {" << std::endl
+        << "\t\t\ttry {" << std::endl
+        << "\t\t\t\tresults[i] = parse(" << text_type << "(inputs[i]));" << std::endl
+        << "\t\t\t} catch (...) {" << std::endl
+        << "\t\t\t\terrors[i] = std::current_exception();" << std::endl
+        << "\t\t\t}" << std::endl
+        << "\t\t}" << std::endl
+        << "\t};" << std::endl
+        << "\tstd::vector<std::thread> workers;" << std::endl
+        << "\tfor (size_t i = 1; i < std::min(threads, inputs.size()); i++) {" << std::endl
+        << "\t\tworkers.emplace_back(worker);" << std::endl
+        << "\t}" << std::endl
+        << "\tworker();" << std::endl
+        << "\tfor (auto &cur_worker: workers) {" << std::endl
+        << "\t\tcur_worker.join();" << std::endl
+        << "\t}" << std::endl
+        << "\tfor (const auto &error: errors) {" << std::endl
+        << "\t\tif (error) {" << std::endl
+        << "\t\t\tstd::rethrow_exception(error);" << std::endl
+        << "\t\t}" << std::endl
+        << "\t}" << std::endl
+        << "\treturn results;" << std::endl
+        << "}" << std::endl;
+    }
 
-    result_cpp
-      << std::endl
-      << "int main() {" << std::endl
-      << "\tstd::string s;" << std::endl
-      << "\tstd::getline(std::cin, s);" << std::endl
-      << "\tauto node = parse(s);" << std::endl;
-    for (const auto &exported_var: exported_vars.find(start)->second) {
+    if (options.bench) {
+      result_cpp << std::endl << bench_generator(options, start).generate();
+    } else {
+      // Reads the first line of stdin, the whole file passed as the argument or the whole stdin for '-'
       result_cpp
-        << "\tstd::cout << \"" << exported_var << " = \" << node->" << exported_var << " << std::endl;" << std::endl;
+        << std::endl
+        << "int main(int argc, char **argv) {" << std::endl
+        << "\tstd::string s;" << std::endl
+        << "\tstd::unique_ptr<mapped_file> file;" << std::endl;
+      if (options.arena) {
+        result_cpp << "\tnode_arena arena;" << std::endl;
+      }
+      if (options.recover) {
+        result_cpp << "\tstd::vector<parse_error> errors;" << std::endl;
+      }
+      if (options.no_exceptions) {
+        result_cpp << "\tparse_status status;" << std::endl;
+      }
+      result_cpp << "\t" << start_ptr << "node;" << std::endl;
+      if (!options.spans) {
+        result_cpp
+          << "\tif (argc > 1 && std::string(argv[1]) == \"-\") {" << std::endl
+          << "\t\tnode = parse(std::cin" << state_arg << ");" << std::endl
+          << "\t} else if (argc > 1) {" << std::endl;
+      } else {
+        result_cpp
+          << "\tif (argc > 1) {" << std::endl;
+      }
+      result_cpp
+        << "\t\tfile = std::make_unique<mapped_file>(argv[1]);" << std::endl
+        << "\t\tnode = parse(*file" << state_arg << ");" << std::endl
+        << "\t} else {" << std::endl
+        << "\t\tstd::getline(std::cin, s);" << std::endl
+        << "\t\tnode = parse(s" << state_arg << ");" << std::endl
+        << "\t}" << std::endl;
+      if (options.recover) {
+        result_cpp
+          << "\tfor (const auto &error: errors) {" << std::endl
+          << "\t\tstd::cerr << \"Error at \" << error.position << \": \" << error.message << std::endl;" << std::endl
+          << "\t}" << std::endl
+          << "\tif (!errors.empty()) {" << std::endl
+          << "\t\treturn 1;" << std::endl
+          << "\t}" << std::endl;
+      }
+      if (options.no_exceptions) {
+        result_cpp
+          << "\tif (!status) {" << std::endl
+          << "\t\tstd::cerr << status.message() << std::endl;" << std::endl
+          << "\t\treturn 1;" << std::endl
+          << "\t}" << std::endl;
+      }
+      for (const auto &exported_var: exported_vars.find(start)->second) {
+        result_cpp
+          << "\tstd::cout << \"" << exported_var << " = \" << " << node_access << exported_var << " << std::endl;" << std::endl;
+      }
+      if (options.profile) {
+        result_cpp << profile_generator::generate_main_epilogue();
+      }
+      result_cpp
+        << "\treturn 0;" << std::endl
+        << "}" << std::endl;
     }
-    result_cpp
-      << "\treturn 0;" << std::endl
-      << "}" << std::endl;
 
     result_cpp.close();
     result_h.close();
@@ -3,8 +3,10 @@
 //
 
 #include <algorithm>
+#include <numeric>
 #include <unordered_set>
 #include "rule.h"
+#include "../generators/profile_generator.h"
 #include "../utils/utils.h"
 #include <cassert>
 
@@ -56,12 +58,12 @@ void rule::add_assign_rule(const std::string &var_name, const std::string &rule)
  */
 void rule::add_assign_text(const std::string &var_name, const std::string &text) {
   rules_.back().emplace_back(RULE_TYPE::ASSIGN_TEXT, var_t(var_name, text));
-  vars.emplace("std::string", var_name);
+  vars.emplace("text_t", var_name);
 }
 
 void rule::add_assign_regex(const std::string &var_name, const std::string &regex_name) {
   rules_.back().emplace_back(RULE_TYPE::ASSIGN_REGEX, var_t(var_name, regex_name));
-  vars.emplace("std::string", var_name);
+  vars.emplace("text_t", var_name);
 }
 
 /**
@@ -101,6 +103,10 @@ void rule::set_name(const std::string &name) {
   rule_name = name;
 }
 
+void rule::set_frequencies(std::vector<uint64_t> alternative_frequencies) {
+  frequencies = std::move(alternative_frequencies);
+}
+
 /**
  * Get non-terminal name
  */
@@ -108,6 +114,10 @@ const std::string &rule::get_name() const {
   return rule_name;
 }
 
+size_t rule::get_alternatives_count() const {
+  return rules_.size();
+}
+
 /**
  * Merge two equally named non-terminal rules, namely merges vars info
  */
@@ -119,35 +129,271 @@ void rule::merge(rule &other) {
   rules_.insert(rules_.end(), other.rules_.begin(), other.rules_.end());
 }
 
+/**
+ * Parameters of generated parse functions: the state of the current parse is passed explicitly, so parsers
+ * do not share anything except immutable lexer tables and may run in parallel.
+ * Every function takes all of them, though EPS alternatives and table steps may use none.
+ */
+std::string parse_params(const generator_options &options) {
+  std::string params = "[[maybe_unused]] lexer &lexer_";
+  if (options.flat) {
+    params += ", [[maybe_unused]] flat_tree &tree_";
+  } else if (options.arena) {
+    params += ", [[maybe_unused]] node_arena &arena_";
+  } else if (options.incremental) {
+    params += ", [[maybe_unused]] old_children &old_";
+  }
+  if (options.recover) {
+    params += ", [[maybe_unused]] std::vector<parse_error> &errors_";
+  }
+  if (options.no_exceptions) {
+    params += ", [[maybe_unused]] parse_status &status_";
+  }
+  return options.table ? params + ", [[maybe_unused]] table_stack &stack_" : params;
+}
+
+std::string parse_args(const generator_options &options) {
+  std::string args = "lexer_";
+  if (options.flat) {
+    args += ", tree_";
+  } else if (options.arena) {
+    args += ", arena_";
+  } else if (options.incremental) {
+    args += ", old_";
+  }
+  if (options.recover) {
+    args += ", errors_";
+  }
+  if (options.no_exceptions) {
+    args += ", status_";
+  }
+  return "(" + (options.table ? args + ", stack_" : args) + ")";
+}
+
+/**
+ * With --no-exceptions parse functions return the error code and can not throw
+ */
+std::string parse_return_type(const generator_options &options) {
+  return options.no_exceptions ? "PARSE_ERROR " : "void ";
+}
+
+std::string parse_specifiers(const generator_options &options) {
+  return options.no_exceptions ? " noexcept" : "";
+}
+
+size_t count_children(const std::vector<std::pair<RULE_TYPE, rule_token_t>> &rule) {
+  return std::count_if(rule.begin(), rule.end(), [](const auto &item) {
+    return item.first == RULE_TYPE::TRANSITION || item.first == RULE_TYPE::ASSIGN_RULE;
+  });
+}
+
+/**
+ * Without exceptions the error code of the child is returned by the parent right away
+ */
+std::string generate_parse_call(const std::string &node, const generator_options &options) {
+  if (!options.no_exceptions) {
+    return "\t\t" + node + "parse" + parse_args(options) + ";\n";
+  }
+  return
+    "\t\tif (PARSE_ERROR error = " + node + "parse" + parse_args(options) + "; error != PARSE_ERROR::NONE) {\n"
+    "\t\t\treturn error;\n"
+    "\t\t}\n";
+}
+
+/**
+ * Code creating and parsing the child node, without the tree (--actions-only) the node is a local value.
+ * With --arena nodes are allocated by the arena of the current parse.
+ * With --flat the local value is moved to the side table of its rule after parsing.
+ * With --table the child is pushed to the stack of the parser and next_state is run after it is parsed,
+ * with --push the child is also reported to the events of the parser.
+ * With --incremental the child is taken from the old tree when it is not damaged by the edit.
+ */
+std::string generate_child(const std::string &child_rule,
+                           const std::string &constructor,
+                           const generator_options &options,
+                           const std::string &next_state) {
+  if (options.table) {
+    std::string open_node = options.flat
+      ? "\t\tstack_.opened.push_back(tree_.open(NODE_KIND::" + child_rule + ", lexer_.position()));\n"
+      : "";
+    if (options.push) {
+      open_node = "\t\tstack_.events->enter(NODE_KIND::" + child_rule + ");\n";
+    }
+    return
+      open_node +
+      "\t\tstack_.states.push_back(" + next_state + ");\n"
+      "\t\tstack_.states.push_back(STATE_" + child_rule + ");\n"
+      "\t\tstack_." + child_rule + "_nodes.emplace_back" + constructor + ";\n";
+  }
+  if (options.flat) {
+    return
+      "\t\tauto node = " + child_rule + "_node" + constructor + ";\n"
+      "\t\tsize_t index = tree_.open(NODE_KIND::" + child_rule + ", lexer_.position());\n" +
+      generate_parse_call("node.", options);
+  }
+  if (options.actions_only) {
+    return
+      "\t\tauto node = " + child_rule + "_node" + constructor + ";\n" +
+      generate_parse_call("node.", options);
+  }
+  if (options.incremental) {
+    std::string inh_args = constructor.substr(1, constructor.size() - 2);
+    return
+      "\t\tauto node = old_.parse<" + child_rule + "_node>(lexer_" + (inh_args.empty() ? "" : ", " + inh_args) + ");\n"
+      "\t\tadd_child(node);\n";
+  }
+  std::string make_node = options.arena ? "arena_.make<" : "std::make_shared<";
+  return
+    "\t\tauto node = " + make_node + child_rule + "_node>" + constructor + ";\n" +
+    generate_parse_call("node->", options) +
+    "\t\tadd_child(node);\n";
+}
+
+std::string generate_child_end(const std::string &child_rule, const generator_options &options) {
+  if (options.table) {
+    std::string close_node = options.flat
+      ? "\t\ttree_.close(stack_.opened.back(), lexer_.position(), tree_." + child_rule + "_attrs, std::move(node));\n"
+        "\t\tstack_.opened.pop_back();\n"
+      : "";
+    if (options.push) {
+      close_node = "\t\tstack_.events->exit(NODE_KIND::" + child_rule + ");\n";
+    }
+    return close_node + "\t\tstack_." + child_rule + "_nodes.pop_back();\n";
+  }
+  if (!options.flat) {
+    return "";
+  }
+  return "\t\ttree_.close(index, lexer_.position(), tree_." + child_rule + "_attrs, std::move(node));\n";
+}
+
+std::string generate_text_child(const generator_options &options) {
+  if (options.flat) {
+    return "\t\ttree_.add_text(token.first, lexer_.position() - token.second.size(), lexer_.position());\n";
+  }
+  if (options.push) {
+    return "\t\tstack_.events->token(token.first, token.second);\n";
+  }
+  if (options.actions_only) {
+    return "";
+  }
+  std::string make_node = options.arena ? "arena_.make<" : "std::make_shared<";
+  return
+    "\t\tauto node = " + make_node + "text_node>(std::move(token.second));\n"
+    "\t\tadd_child(node);\n";
+}
+
+/**
+ * The text of the token is moved to the variable, in the tree the text node moves it instead, so it is copied first
+ */
+std::string assign_token(const std::string &var_name, const std::string &text_child, const generator_options &options) {
+  if (!options.actions_only) {
+    return "\t\t" + var_name + " = token.second;\n" + text_child;
+  }
+  return text_child + "\t\t" + var_name + " = std::move(token.second);\n";
+}
+
+/**
+ * With --recover the error is recorded, the rule skips tokens until its FOLLOW set and the alternative is abandoned.
+ * With --no-exceptions the message is not built, the found token and the expected type are kept instead.
+ */
+std::string generate_error(const std::string &message, const std::string &expected, const generator_options &options) {
+  if (options.no_exceptions) {
+    return
+      "\t\tlexer_.undo();\n"
+      "\t\treturn status_.fail(PARSE_ERROR::UNEXPECTED_TOKEN, lexer_.position(), std::move(token.second), TOKEN_TYPE::"
+      + expected + ");\n";
+  }
+  if (!options.recover) {
+    return "\t\tthrow std::runtime_error(" + message + ");\n";
+  }
+  return
+    "\t\tlexer_.undo();\n"
+    "\t\trecover(lexer_, errors_, " + message + ");\n"
+    "\t\treturn;\n";
+}
+
+/**
+ * Token type of the terminal from FIRST or FOLLOW set, literals are quoted
+ */
+std::string terminal_type(const std::string &terminal, const lexer_generator &lexer_generator_) {
+  if (terminal.size() >= 2 && terminal[0] == '\'' && terminal.back() == '\'') {
+    return lexer_generator_.get_literal_type(terminal.substr(1, terminal.size() - 2));
+  }
+  return terminal;
+}
+
+/**
+ * Whether the code contains the identifier as a whole word
+ */
+bool uses_identifier(const std::string &code, const std::string &name) {
+  auto is_word = [](char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+  };
+  for (size_t pos = code.find(name); pos != std::string::npos; pos = code.find(name, pos + 1)) {
+    size_t end = pos + name.size();
+    if ((pos == 0 || !is_word(code[pos - 1])) && (end == code.size() || !is_word(code[end]))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * With --table name is the prefix of step functions and state is the prefix of their states:
+ * every child rule ends the current step, the rest of the alternative is the next step run after the child is parsed.
+ * constructors are the arguments of the children of the alternative by their indices.
+ * prologue starts the first function of the alternative and step_prologue the next steps (--profile).
+ */
 std::string generate_rule(
   const std::vector<std::pair<RULE_TYPE, rule_token_t>> &rule,
+  const std::string &prologue,
+  const std::string &step_prologue,
   const std::string &name,
-  const std::unordered_map<std::string, std::string> &constructors,
-  const std::unordered_map<std::string, std::set<std::string>> &exported_vars_names) {
-  std::string code;
+  const std::string &state,
+  const std::vector<std::string> &constructors,
+  const std::unordered_map<std::string, std::set<std::string>> &exported_vars_names,
+  const lexer_generator &lexer_generator_,
+  const generator_options &options) {
+  std::string code, header = std::string(options.constexpr_parser ? "constexpr " : "") + parse_return_type(options);
+  std::string count_token = options.profile ? "\tprofile_.tokens++;\n" : "";
+  size_t step = 0;
   code +=
-    "void " + name + "() {\n"
-    "\tstd::pair<TOKEN_TYPE, std::string> token;\n";
-  for (const auto&[type, data]: rule) {
+    header + (options.table ? name + "_0" : name) + "(" + parse_params(options) + ")" + parse_specifiers(options) + " {\n" +
+    prologue +
+    "\ttoken_t token;\n";
+  auto next_step = [&](const std::string &child_rule) {
+    if (!options.table) {
+      return std::string();
+    }
+    step++;
+    return
+      "\t}\n"
+      "}\n"
+      "\n" +
+      header + name + "_" + std::to_string(step) + "(" + parse_params(options) + ") {\n" +
+      step_prologue +
+      "\ttoken_t token;\n"
+      "\t{\n"
+      "\t\tauto &node = stack_." + child_rule + "_nodes.back();\n";
+  };
+  std::string text_child = generate_text_child(options);
+  for (size_t item = 0; item < rule.size(); item++) {
+    const auto&[type, data] = rule[item];
     if (type == RULE_TYPE::TEXT) {
       const std::string &data_ = std::get<NON_ASSIGN_TYPE>(data);
       code +=
         "\ttoken = lexer_.next();\n"
-        "\tif (token.first != TOKEN_TYPE::TEXT || token.second != \"" + escape(data_) + "\") {\n"
-        "\t\tthrow std::runtime_error(\"Found token '\" + token.second + \"' but expected '" + escape(data_) + "'\");\n"
-        "\t}\n"
-        "\t{\n"
-        "\t\tauto node = std::make_shared<text_node>(token.second);\n"
-        "\t\tadd_child(node);\n"
-        "\t}\n";
+        "\tif (token.first != TOKEN_TYPE::" + lexer_generator_.get_literal_type(data_) + ") {\n" +
+        generate_error("\"Found token '\" + std::string(token.second) + \"' but expected '" + escape(data_) + "'\"", lexer_generator_.get_literal_type(data_), options) +
+        "\t}\n" +
+        count_token;
+      if (!text_child.empty()) {
+        code += "\t{\n" + text_child + "\t}\n";
+      }
     } else if (type == RULE_TYPE::TRANSITION) {
       const std::string &data_ = std::get<NON_ASSIGN_TYPE>(data);
-      code +=
-        "\t{\n"
-        "\t\tauto node = std::make_shared<" + data_ + "_node>" + constructors.find(data_)->second + ";\n"
-        "\t\tnode->parse();\n"
-        "\t\tadd_child(node);\n"
-        "\t}\n";
+      code += "\t{\n" + generate_child(data_, constructors[item], options, state + std::to_string(step + 1));
+      code += next_step(data_) + generate_child_end(data_, options) + "\t}\n";
     } else if (type == RULE_TYPE::TRANSITION_REGEX) {
       const std::string &data_ = std::get<NON_ASSIGN_TYPE>(data);
       if (data_ == "EPS") {
@@ -155,51 +401,60 @@ std::string generate_rule(
       }
       code +=
         "\ttoken = lexer_.next();\n"
-        "\tif (token.first != TOKEN_TYPE::" + data_ + ") {\n"
-        "\t\tthrow std::runtime_error(\"Found unexpected token, expected " + data_ + " \");\n"
-        "\t}\n"
-        "\t{\n"
-        "\t\tauto node = std::make_shared<text_node>(token.second);\n"
-        "\t\tadd_child(node);\n"
-        "\t}\n";
+        "\tif (token.first != TOKEN_TYPE::" + data_ + ") {\n" +
+        generate_error("\"Found unexpected token, expected " + data_ + " \"", data_, options) +
+        "\t}\n" +
+        count_token;
+      if (!text_child.empty()) {
+        code += "\t{\n" + text_child + "\t}\n";
+      }
     } else if (type == RULE_TYPE::ASSIGN_RULE) {
       const auto&[var_name, assign_rule] = std::get<ASSIGN_TYPE>(data);
       code +=
-        "\t{\n"
-        "\t\tauto node = std::make_shared<" + assign_rule + "_node>" + constructors.find(assign_rule)->second + ";\n"
-        "\t\tnode->parse();\n"
-        "\t\tadd_child(node);\n";
+        "\t{\n" +
+        generate_child(assign_rule, constructors[item], options, state + std::to_string(step + 1));
+      code += next_step(assign_rule);
       for (const auto &exported_var: exported_vars_names.find(assign_rule)->second) {
-        code += "\t\t" + var_name + "_" + exported_var + " = node->" + exported_var + ";\n";
+        // Without the tree the child is destroyed right after, so its variables are moved
+        std::string value = "node->" + exported_var;
+        if (options.flat) {
+          value = "node." + exported_var;
+        } else if (options.actions_only) {
+          value = "std::move(node." + exported_var + ")";
+        }
+        code += "\t\t" + var_name + "_" + exported_var + " = " + value + ";\n";
       }
-      code += "\t}\n";
+      code += generate_child_end(assign_rule, options) + "\t}\n";
     } else if (type == RULE_TYPE::ASSIGN_TEXT) {
       const auto&[var_name, assign_text] = std::get<ASSIGN_TYPE>(data);
+      // Assigned literals have no text node in the tree, only --incremental needs it to count the tokens of nodes
+      // and --push reports every token
+      std::string literal_child = options.incremental || options.push ? text_child : "";
       code +=
         "\ttoken = lexer_.next();\n"
-        "\tif (token.first != TOKEN_TYPE::TEXT || token.second != \"" + escape(assign_text) + "\") {\n"
-        "\t\tthrow std::runtime_error(\"Found token '\" + token.second + \"' but expected '" + escape(assign_text) + "'\");\n"
-        "\t}"
-        "\t{\n"
-        "\t\t" + var_name + " = token.second;\n"
+        "\tif (token.first != TOKEN_TYPE::" + lexer_generator_.get_literal_type(assign_text) + ") {\n" +
+        generate_error("\"Found token '\" + std::string(token.second) + \"' but expected '" + escape(assign_text) + "'\"", lexer_generator_.get_literal_type(assign_text), options) +
+        "\t}\n" +
+        count_token +
+        "\t{\n" +
+        assign_token(var_name, literal_child, options) +
         "\t}\n";
     } else if (type == RULE_TYPE::ASSIGN_REGEX) {
       const auto&[var_name, regex_name] = std::get<ASSIGN_TYPE>(data);
       code +=
         "\ttoken = lexer_.next();\n"
-        "\tif (token.first != TOKEN_TYPE::" + regex_name + ") {\n"
-        "\t\tthrow std::runtime_error(\"Found unexpected token, expected " + regex_name + "\");\n"
-        "\t}\n"
-        "\t{\n"
-        "\t\tauto node = std::make_shared<text_node>(token.second);\n"
-        "\t\tadd_child(node);\n"
-        "\t\t" + var_name + " = token.second;\n"
+        "\tif (token.first != TOKEN_TYPE::" + regex_name + ") {\n" +
+        generate_error("\"Found unexpected token, expected " + regex_name + "\"", regex_name, options) +
+        "\t}\n" +
+        count_token +
+        "\t{\n" +
+        assign_token(var_name, text_child, options) +
         "\t}\n";
     } else { // RULE_TYPE::CALL
       code += "\t" + std::get<NON_ASSIGN_TYPE>(data) + "();\n";
     }
   }
-  code += "}";
+  code += options.no_exceptions ? "\treturn PARSE_ERROR::NONE;\n}" : "}";
   return code;
 }
 
@@ -215,20 +470,97 @@ std::string rule::generate_constructor() const {
   return code;
 }
 
+/**
+ * Without the tree the variable passed to the child is moved if nothing reads it after the child:
+ * no later action or child of the alternative uses it and the parent does not read it.
+ * With the tree variables stay in the nodes, so they are copied.
+ */
+std::vector<std::string> rule::generate_child_constructors(
+  size_t rule_id,
+  const std::unordered_map<std::string, std::string> &constructors,
+  const std::unordered_map<std::string, std::set<std::string>> &exported_vars_names,
+  const generator_options &options) const {
+  const auto &alternative = rules_[rule_id];
+  std::vector<std::vector<std::string>> args(alternative.size());
+  for (size_t i = 0; i < alternative.size(); i++) {
+    const auto&[type, data] = alternative[i];
+    if (type != RULE_TYPE::TRANSITION && type != RULE_TYPE::ASSIGN_RULE) {
+      continue;
+    }
+    std::string child = type == RULE_TYPE::TRANSITION ? std::get<NON_ASSIGN_TYPE>(data) : std::get<ASSIGN_TYPE>(data).second;
+    std::string constructor = constructors.at(child);
+    constructor = constructor.substr(1, constructor.size() - 2);
+    for (size_t begin = 0, end; !constructor.empty() && begin <= constructor.size(); begin = end + 2) {
+      end = std::min(constructor.find(", ", begin), constructor.size());
+      args[i].push_back(constructor.substr(begin, end - begin));
+    }
+  }
+
+  auto read_after = [&](size_t item, const std::string &var_name) {
+    if (std::count(args[item].begin(), args[item].end(), var_name) > 1) {
+      return true;
+    }
+    if (exported_vars_names.at(rule_name).count(var_name) != 0) {
+      return true;
+    }
+    for (size_t i = item + 1; i < alternative.size(); i++) {
+      const auto&[type, data] = alternative[i];
+      if (std::find(args[i].begin(), args[i].end(), var_name) != args[i].end()) {
+        return true;
+      }
+      if (type == RULE_TYPE::CALL) {
+        auto fun = funs.find(std::get<NON_ASSIGN_TYPE>(data));
+        if (fun == funs.end() || uses_identifier(fun->second, var_name)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  std::vector<std::string> child_constructors(alternative.size());
+  for (size_t i = 0; i < alternative.size(); i++) {
+    std::string code = "(";
+    for (size_t j = 0; j < args[i].size(); j++) {
+      const std::string &var_name = args[i][j];
+      bool move = options.actions_only && !options.flat && !read_after(i, var_name);
+      code += (j == 0 ? "" : ", ") + (move ? "std::move(" + var_name + ")" : var_name);
+    }
+    child_constructors[i] = code + ")";
+  }
+  return child_constructors;
+}
+
 std::pair<std::string, std::string> rule::generate_class(
   const std::unordered_map<std::string, std::string> &constructors,
   const std::unordered_map<std::string, std::set<std::string>> &exported_vars_names,
-  grammar_analyzer &analyzer) const {
+  const grammar_analyzer &analyzer,
+  const lexer_generator &lexer_generator_,
+  const generator_options &options) const {
   std::string code, struct_name = rule_name + "_node";
-  code += "struct " + struct_name + " : public inner_node {\n";
+  std::string constexpr_ = options.constexpr_parser ? "constexpr " : "";
+  code += "struct " + struct_name + (options.actions_only ? "" : " : public inner_node") + " {\n";
   ////////// VARIABLES GENERATION //////////
   for (const auto&[var_type, var_name]: vars) {
-    code += "\t" + var_type + " " + var_name + ";\n";
+    code += "\t" + var_type + " " + var_name + (options.constexpr_parser ? "{}" : "") + ";\n";
+  }
+
+  // With --incremental the old node is reused only if it was constructed with the same arguments
+  std::string inh_types, inh_names;
+  for (size_t i = 0; i < inh_vars.size(); i++) {
+    inh_types += (i == 0 ? "" : ", ") + inh_vars[i].first;
+    inh_names += (i == 0 ? "" : ", ") + inh_vars[i].second;
+  }
+  if (options.incremental) {
+    code += "\tstd::tuple<" + inh_types + "> inherited;\n";
+  }
+  if (!options.actions_only) {
+    code += "\tstatic constexpr NODE_KIND KIND = NODE_KIND::" + rule_name + ";\n";
   }
 
   ////////// CONSTRUCTOR CODE GENERATION //////////
   code += "\n"
-          "\t" + struct_name + "(";
+          "\t" + constexpr_ + struct_name + "(";
   std::set<std::string> cons_arg;
   for (size_t i = 0; i < inh_vars.size(); i++) {
     if (i != 0) {
@@ -237,25 +569,236 @@ std::pair<std::string, std::string> rule::generate_class(
     code += inh_vars[i].first + " _" + inh_vars[i].second;
     cons_arg.insert(inh_vars[i].second);
   }
-  code += ") {\n";
+  // Arguments are taken by value and moved to the members in the order of declaration
+  std::vector<std::string> initializers;
+  if (!options.actions_only) {
+    initializers.emplace_back("inner_node(KIND)");
+  }
   for (const auto&[var_type, var_name]: vars) {
     if (cons_arg.find(var_name) != cons_arg.end()) {
-      code += "\t\t" + var_name + " = _" + var_name + ";\n";
+      initializers.push_back(var_name + "(std::move(_" + var_name + "))");
     }
   }
+  code += ")";
+  for (size_t i = 0; i < initializers.size(); i++) {
+    code += (i == 0 ? "\n\t\t: " : "\n\t\t, ") + initializers[i];
+  }
+  code += " {\n";
+  if (options.incremental) {
+    code += "\t\tinherited = std::make_tuple(" + inh_names + ");\n";
+  }
   code += "\t}\n";
 
   ////////// PARSER CODE GENERATION //////////
-  std::string parse_code;
-  code +=
-    "\tvoid visit() override;\n"
-    "\tvoid parse() override;\n";
-  parse_code +=
-    "void " + struct_name + "::parse() {\n"
-    "\tauto token = lexer_.next();\n";
-  size_t rule_id = 0;
-  std::string rules_code, other_funs;
-  std::optional<std::string> eps_rule;
+  std::string parse_code, lexer_param = parse_params(options);
+  std::string return_type = parse_return_type(options), specifiers = parse_specifiers(options);
+  std::string type_var = options.recover ? "token.first" : "type";
+  // With --table the alternative is chosen by the predict table of the parser loop
+  if (!options.table) {
+    code += "\t" + constexpr_ + return_type + "parse(" + lexer_param + ")" + specifiers + ";\n";
+    parse_code +=
+      constexpr_ + return_type + struct_name + "::parse(" + lexer_param + ")" + specifiers + " {\n" +
+      (options.profile ? profile_generator::generate_scope(profile_generator::rule_entry(rule_name), "\t") : "") +
+      (options.recover
+       ? "\ttoken_t token = lexer_.next();\n"
+         "\tlexer_.undo();\n"
+       : "\tTOKEN_TYPE type = lexer_.next().first;\n"
+         "\tlexer_.undo();\n");
+  }
+  std::vector<std::vector<std::string>> predict_types = get_predict_types(analyzer, lexer_generator_);
+  std::string rules_code, other_funs, parse_args = ::parse_args(options);
+  // A token predicting several alternatives chooses the first declared one whatever the order of the cases is
+  std::vector<std::vector<std::string>> alternative_types(rules_.size());
+  std::set<std::string> used_types;
+  for (size_t rule_id = 0; rule_id < rules_.size(); rule_id++) {
+    for (const auto &type: predict_types[rule_id]) {
+      if (used_types.insert(type).second) {
+        alternative_types[rule_id].push_back(type);
+      }
+    }
+  }
+
+  // With --pgo alternatives are dispatched and defined from the most frequent one, so hot ones are laid out together
+  auto frequency = [&](size_t rule_id) {
+    return rule_id < frequencies.size() ? frequencies[rule_id] : 0;
+  };
+  uint64_t total = std::accumulate(frequencies.begin(), frequencies.end(), uint64_t(0));
+  std::vector<size_t> order(rules_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return frequency(a) > frequency(b);
+  });
+  auto attribute = [&](size_t rule_id) {
+    if (frequencies.empty()) {
+      return "";
+    }
+    if (frequency(rule_id) == 0) {
+      return "__attribute__((cold)) ";
+    }
+    return frequency(rule_id) * 2 > total ? "__attribute__((hot)) " : "";
+  };
+  auto call = [&](size_t rule_id, const std::string &indent) {
+    std::string parse_call = "parse_" + std::to_string(rule_id) + parse_args;
+    return options.no_exceptions
+      ? indent + "return " + parse_call + ";\n"
+      : indent + parse_call + ";\n" + indent + "return;\n";
+  };
+  // The alternative taken by most calls is checked before the switch, if it is predicted by a couple of tokens
+  size_t hot = order[0];
+  bool hot_check = !options.table && rules_.size() > 1 && frequency(hot) * 2 > total
+    && !alternative_types[hot].empty() && alternative_types[hot].size() <= 2;
+  if (hot_check) {
+    std::string condition;
+    for (const auto &type: alternative_types[hot]) {
+      condition += (condition.empty() ? "" : " || ") + type_var + " == TOKEN_TYPE::" + type;
+    }
+    parse_code +=
+      "\tif (__builtin_expect(" + condition + ", 1)) { // " +
+      std::to_string(frequency(hot) * 100 / total) + "% of calls\n" +
+      call(hot, "\t\t") +
+      "\t}\n";
+  }
+  if (!options.table) {
+    parse_code += "\tswitch (" + type_var + ") {\n";
+  }
+  for (size_t rule_id: order) {
+    if (!alternative_types[rule_id].empty() && !(hot_check && rule_id == hot)) {
+      for (const auto &type: alternative_types[rule_id]) {
+        parse_code += "\t\tcase TOKEN_TYPE::" + type + ":\n";
+      }
+      parse_code += call(rule_id, "\t\t\t");
+    }
+
+    std::string name = (options.table ? "step_" : "parse_") + std::to_string(rule_id);
+    if (options.table) {
+      for (size_t step = 0; step <= count_children(rules_[rule_id]); step++) {
+        other_funs +=
+          "\t" + std::string(attribute(rule_id)) + "void " + name + "_" + std::to_string(step) + "(" + lexer_param + ");\n";
+      }
+    } else {
+      other_funs +=
+        "\t" + std::string(attribute(rule_id)) + constexpr_ + return_type + name + "(" + lexer_param + ")" + specifiers + ";\n";
+    }
+    std::string prologue, step_prologue;
+    if (options.profile) {
+      step_prologue = options.table ? profile_generator::generate_scope(profile_generator::rule_entry(rule_name), "\t") : "";
+      prologue = step_prologue + profile_generator::generate_alternative_counter(rule_name, rule_id);
+    }
+    rules_code += generate_rule(rules_[rule_id],
+                                prologue,
+                                step_prologue,
+                                struct_name + "::" + name,
+                                "STATE_" + rule_name + "_" + std::to_string(rule_id) + "_",
+                                generate_child_constructors(rule_id, constructors, exported_vars_names, options),
+                                exported_vars_names,
+                                lexer_generator_,
+                                options);
+    rules_code += "\n\n";
+  }
+  if (options.table) {
+    parse_code.clear();
+  } else if (options.recover) {
+    parse_code +=
+      "\t\tdefault:\n"
+      "\t\t\trecover(lexer_, errors_, \"Found token '\" + std::string(token.second) + \"' but expected " + rule_name + "\");\n"
+      "\t\t\treturn;\n"
+      "\t}\n"
+      "}\n"
+      "\n" +
+      generate_recover(analyzer, lexer_generator_);
+    other_funs += "\tstatic void recover(lexer &lexer_, std::vector<parse_error> &errors_, std::string message);\n";
+  } else {
+    parse_code +=
+      "\t\tdefault:\n" +
+      std::string(options.no_exceptions ? "\t\t\treturn PARSE_ERROR::NONE;\n" : "\t\t\treturn;\n") +
+      "\t}\n"
+      "}\n";
+  }
+  code += other_funs;
+
+  ////////// ATTRIBUTES CODE GENERATION //////////
+  // Template actions may be constexpr even if they call functions which are not, then they are evaluated at runtime
+  std::string attr_prefix = options.constexpr_parser ? "template<typename = void> constexpr " : "";
+  for (const auto &[attr_name, attr_code]: funs) {
+    code +=
+      "\n\n\t" + attr_prefix + "void " + attr_name + "() {\n" +
+      (options.profile ? profile_generator::generate_scope(profile_generator::fun_entry(rule_name, attr_name), "\t\t") : "") +
+      attr_code +
+      "\t}";
+  }
+  code += "\n};\n";
+  return {code, parse_code + rules_code};
+}
+
+/**
+ * Panic mode: tokens are skipped until one which may follow the rule, so its parent can continue
+ */
+std::string rule::generate_recover(const grammar_analyzer &analyzer, const lexer_generator &lexer_generator_) const {
+  std::set<std::string> follow_types{"END"};
+  for (const auto &terminal: analyzer.get_follow(rule_name)) {
+    follow_types.insert(terminal_type(terminal, lexer_generator_));
+  }
+  std::string cases;
+  for (const auto &type: follow_types) {
+    cases += "\t\t\tcase TOKEN_TYPE::" + type + ":\n";
+  }
+  return
+    "void " + rule_name + "_node::recover(lexer &lexer_, std::vector<parse_error> &errors_, std::string message) {\n"
+    "\terrors_.push_back({lexer_.position(), std::move(message)});\n"
+    "\twhile (true) {\n"
+    "\t\tswitch (lexer_.next().first) {\n" +
+    cases +
+    "\t\t\t\tlexer_.undo();\n"
+    "\t\t\t\treturn;\n"
+    "\t\t\tdefault:\n"
+    "\t\t\t\tbreak;\n"
+    "\t\t}\n"
+    "\t}\n"
+    "}\n";
+}
+
+/**
+ * When the start rule ends before the end of the input, tokens are skipped until one which may start it again,
+ * so the rest of the input is parsed for its errors too. Tokens of its FOLLOW set would not be consumed by it.
+ */
+std::string rule::generate_resume(const grammar_analyzer &analyzer, const lexer_generator &lexer_generator_) const {
+  std::set<std::string> first_types;
+  for (const auto &terminal: analyzer.get_first({rule_name})) {
+    if (terminal != "EPS" && terminal != "END") {
+      first_types.insert(terminal_type(terminal, lexer_generator_));
+    }
+  }
+  std::string cases;
+  for (const auto &type: first_types) {
+    cases += "\t\t\tcase TOKEN_TYPE::" + type + ":\n";
+  }
+  if (!cases.empty()) {
+    cases +=
+      "\t\t\t\tlexer_.undo();\n"
+      "\t\t\t\treturn true;\n";
+  }
+  return
+    "// Skips tokens until one which may start " + rule_name + ", returns false at the end of the input\n"
+    "static bool resume_" + rule_name + "(lexer &lexer_) {\n"
+    "\twhile (true) {\n"
+    "\t\tswitch (lexer_.next().first) {\n" +
+    cases +
+    "\t\t\tcase TOKEN_TYPE::END:\n"
+    "\t\t\t\treturn false;\n"
+    "\t\t\tdefault:\n"
+    "\t\t\t\tbreak;\n"
+    "\t\t}\n"
+    "\t}\n"
+    "}\n";
+}
+
+/**
+ * Token types choosing each alternative: its FIRST set, and FOLLOW set of the rule if the alternative may be empty.
+ * Alternatives are tried in order, so a token predicting several of them chooses the first one.
+ */
+std::vector<std::vector<std::string>> rule::get_predict_types(const grammar_analyzer &analyzer,
+                                                           const lexer_generator &lexer_generator_) const {
+  std::vector<std::vector<std::string>> predict_types;
   for (const auto &cur_rule: rules_) {
     std::vector<std::string> filtered_rule;
     for (const auto&[type, rule]: cur_rule) {
@@ -270,73 +813,68 @@ std::pair<std::string, std::string> rule::generate_class(
       }
     }
 
-    for (const auto &f: analyzer.get_first(filtered_rule)) {
-      if (f == "EPS") {
-        eps_rule = "parse_" + std::to_string(rule_id);
-      } else {
-        if (f[0] == '\'' && f.back() == '\'') {
-          parse_code +=
-            "\tif (token.first == TOKEN_TYPE::TEXT && token.second == \"" + f.substr(1, f.size() - 2) + "\") {\n"
-            "\t\tlexer_.undo();\n"
-            "\t\tparse_" + std::to_string(rule_id) + "();\n"
-            "\t\treturn;\n"
-            "\t}\n";
-        } else {
-          parse_code +=
-            "\tif (token.first == TOKEN_TYPE::" + f + ") {\n"
-            "\t\tlexer_.undo();\n"
-            "\t\tparse_" + std::to_string(rule_id) + "();\n"
-            "\t\treturn;\n"
-            "\t}\n";
-        }
-      }
+    std::set<std::string> predict = analyzer.get_first(filtered_rule);
+    if (predict.erase("EPS") > 0) {
+      const auto &follow = analyzer.get_follow(rule_name);
+      predict.insert(follow.begin(), follow.end());
     }
-
-    other_funs += "\tvoid parse_" + std::to_string(rule_id) + "();\n";
-    rules_code += generate_rule(cur_rule,
-                                struct_name + "::parse_" + std::to_string(rule_id++),
-                                constructors,
-                                exported_vars_names);
-    rules_code += "\n\n";
+    std::vector<std::string> types;
+    for (const auto &terminal: predict) {
+      types.push_back(terminal_type(terminal, lexer_generator_));
+    }
+    predict_types.push_back(types);
   }
+  return predict_types;
+}
 
-  if (eps_rule.has_value()) {
-    for (auto f: analyzer.get_follow(rule_name)) {
-      if (f[0] == '\'' && f.back() == '\'') {
-        f = f.substr(1, f.size() - 2); // Remove quotes from begin and end
-        parse_code +=
-          "\tif (token.first == TOKEN_TYPE::TEXT && token.second == \"" + f + "\") {\n"
-          "\t\tlexer_.undo();\n"
-          "\t\t" + *eps_rule + "();\n"
-          "\t\treturn;\n"
-          "\t}\n";
-      } else {
-        parse_code +=
-          "\tif (token.first == TOKEN_TYPE::" + f + ") {\n"
-          "\t\tlexer_.undo();\n"
-          "\t\t" + *eps_rule + "();\n"
-          "\t\treturn;\n"
-          "\t}\n";
+/**
+ * States of the table parser with the child rules parsed before them:
+ * step k of the alternative is run after its k-th child rule is parsed, the first step has no child
+ */
+std::vector<rule::table_state> rule::get_table_states() const {
+  std::vector<table_state> states;
+  for (size_t rule_id = 0; rule_id < rules_.size(); rule_id++) {
+    std::string state = "STATE_" + rule_name + "_" + std::to_string(rule_id) + "_";
+    size_t step = 0;
+    states.push_back({state + std::to_string(step++), "", 0});
+    for (const auto&[type, data]: rules_[rule_id]) {
+      if (type == RULE_TYPE::TRANSITION) {
+        states.push_back({state + std::to_string(step++), std::get<NON_ASSIGN_TYPE>(data), 0});
+      } else if (type == RULE_TYPE::ASSIGN_RULE) {
+        states.push_back({state + std::to_string(step++), std::get<ASSIGN_TYPE>(data).second, 0});
+      } else if (type != RULE_TYPE::CALL && !(type == RULE_TYPE::TRANSITION_REGEX && std::get<NON_ASSIGN_TYPE>(data) == "EPS")) {
+        states.back().tokens++;
       }
     }
   }
-  parse_code +=
-    "\tlexer_.undo();\n"
-    "}\n";
-  code += other_funs;
+  return states;
+}
 
-  ////////// ATTRIBUTES CODE GENERATION //////////
-  for (const auto &[attr_name, attr_code]: funs) {
-    code +=
-      "\n\n\tvoid " + attr_name + "() {\n" +
-      attr_code +
-      "\t}";
+/**
+ * Whether actions or children of the rule may read the variable, or it is exported further
+ */
+bool rule::reads_var(const std::string &var_name, const std::unordered_map<std::string, std::string> &constructors) const {
+  for (const auto &exported_var: exported_vars) {
+    if (exported_var.second == var_name) {
+      return true;
+    }
   }
-  code += "\n};\n";
-
-  ////////// VISITOR CODE GENERATION //////////
-  rules_code += "void " + struct_name + "::visit() {}";
-  return {code, parse_code + rules_code};
+  for (const auto &alternative: rules_) {
+    for (const auto&[type, data]: alternative) {
+      if (type == RULE_TYPE::CALL) {
+        auto fun = funs.find(std::get<NON_ASSIGN_TYPE>(data));
+        if (fun == funs.end() || uses_identifier(fun->second, var_name)) {
+          return true;
+        }
+      } else if (type == RULE_TYPE::TRANSITION || type == RULE_TYPE::ASSIGN_RULE) {
+        std::string child = type == RULE_TYPE::TRANSITION ? std::get<NON_ASSIGN_TYPE>(data) : std::get<ASSIGN_TYPE>(data).second;
+        if (uses_identifier(constructors.at(child), var_name)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
 }
 
 const std::set<var_t> &rule::get_exported_vars() const {
@@ -5,12 +5,15 @@
 #ifndef PARSER_GENERATOR_PARSER_RULE_H_
 #define PARSER_GENERATOR_PARSER_RULE_H_
 
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
 #include <set>
 #include <variant>
 #include <unordered_map>
+#include "../generators/generator_options.h"
+#include "../generators/lexer_generator.h"
 #include "../grammar/grammar_analyzer.h"
 #include "rule_cfg.h"
 #include "rule_utils.h"
@@ -20,6 +23,12 @@ using rule_token_t = std::variant<std::string, var_t>;
 
 struct rule {
  public:
+  // State of the table parser: the child rule parsed before the step and the number of tokens the step reads
+  struct table_state {
+    std::string name, child_rule;
+    size_t tokens;
+  };
+
   rule();
 
   void add_var(const std::string &var_type, const std::string &var_name);
@@ -34,20 +43,31 @@ struct rule {
   void add_fun_call(const std::string &fun);
   void add_str(const std::string &str);
   void set_name(const std::string &name);
+  // Number of times every alternative was taken in the runs of the instrumented parser (--pgo)
+  void set_frequencies(std::vector<uint64_t> alternative_frequencies);
 
   const std::string &get_name() const;
+  size_t get_alternatives_count() const;
   std::vector<var_t> get_assigns() const;
   const std::set<var_t> &get_exported_vars() const;
   std::vector<std::string> get_fun_names() const;
+  std::vector<std::vector<std::string>> get_predict_types(const grammar_analyzer &analyzer,
+                                                          const lexer_generator &lexer_generator_) const;
+  std::vector<table_state> get_table_states() const;
+  bool reads_var(const std::string &var_name, const std::unordered_map<std::string, std::string> &constructors) const;
 
   void merge(rule& other);
 
   std::pair<std::string, std::string> generate_class(
     const std::unordered_map<std::string, std::string> &constructors,
     const std::unordered_map<std::string, std::set<std::string>> &exported_vars_names,
-    grammar_analyzer &analyzer) const;
+    const grammar_analyzer &analyzer,
+    const lexer_generator &lexer_generator_,
+    const generator_options &options) const;
   rule_cfg generate_cfg() const;
   std::string generate_constructor() const;
+  // Skipping of tokens after the start rule has ended before the end of the input (--recover)
+  std::string generate_resume(const grammar_analyzer &analyzer, const lexer_generator &lexer_generator_) const;
 
  private:
   std::string rule_name;
@@ -56,6 +76,14 @@ struct rule {
   std::set<var_t> exported_vars;
   std::unordered_map<std::string, std::string> funs;
   std::vector<std::vector<std::pair<RULE_TYPE, rule_token_t>>> rules_;
+  std::vector<uint64_t> frequencies;
+
+  std::string generate_recover(const grammar_analyzer &analyzer, const lexer_generator &lexer_generator_) const;
+  std::vector<std::string> generate_child_constructors(
+    size_t rule_id,
+    const std::unordered_map<std::string, std::string> &constructors,
+    const std::unordered_map<std::string, std::set<std::string>> &exported_vars_names,
+    const generator_options &options) const;
 };
 
 #endif //PARSER_GENERATOR_PARSER_RULE_H_
@@ -3,7 +3,6 @@
 //
 
 #include "rule_parser.h"
-#include "../utils/utils.h"
 
 rule_parser::rule_parser(std::string s, lexer_generator &lexer_generator)
   : lexer_(std::move(s))
@@ -72,7 +71,7 @@ void rule_parser::parse_rule_inner(rule &cur_rule) {
       }
     } else if (token.type == TOKEN_TYPE::TEXT) {
       cur_rule.add_str(token.data);
-      lexer_generator_.add_token(escape(token.data));
+      lexer_generator_.add_token(token.data);
     } else if (token.type == TOKEN_TYPE::DOLLAR) {
       auto fun = lexer_.next();
       if (fun.type != TOKEN_TYPE::ID) {
@@ -104,7 +103,7 @@ void rule_parser::parse_rule_inner(rule &cur_rule) {
         }
       } else {
         cur_rule.add_assign_text(var_name.data, rule_name.data);
-        lexer_generator_.add_token(escape(rule_name.data));
+        lexer_generator_.add_token(rule_name.data);
       }
     } else {
       throw std::runtime_error("Unknown token");
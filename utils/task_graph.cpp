@@ -0,0 +1,118 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#include "task_graph.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+task_graph::task_graph(size_t size)
+  : dependencies_count(size, 0), dependents(size) {}
+
+void task_graph::add_dependency(size_t task, size_t dependency) {
+  dependencies_count[task]++;
+  dependents[dependency].push_back(task);
+}
+
+namespace {
+struct task_deque {
+  std::mutex mutex;
+  std::deque<size_t> tasks;
+};
+}
+
+void task_graph::run(const std::function<void(size_t)> &task, size_t threads) const {
+  threads = std::max<size_t>(threads, 1);
+  std::vector<std::atomic<size_t>> pending(dependents.size());
+  std::vector<task_deque> deques(threads);
+  for (size_t i = 0, ready = 0; i < dependents.size(); i++) {
+    pending[i].store(dependencies_count[i], std::memory_order_relaxed);
+    if (dependencies_count[i] == 0) {
+      deques[ready++ % threads].tasks.push_back(i);
+    }
+  }
+
+  std::atomic<size_t> remaining(dependents.size());
+  std::atomic<size_t> queued(0), sleeping(0);
+  for (const task_deque &deque: deques) {
+    queued.fetch_add(deque.tasks.size());
+  }
+  // Idle threads sleep until a task is queued or all tasks are finished. A sleeping thread is counted
+  // before it checks the queue, and a task is counted before the sleeping threads are, so either the thread
+  // sees the task or the task is followed by a notification
+  std::mutex idle_mutex;
+  std::condition_variable idle;
+  auto notify = [&](bool all) {
+    if (sleeping.load() == 0) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(idle_mutex);
+    }
+    if (all) {
+      idle.notify_all();
+    } else {
+      idle.notify_one();
+    }
+  };
+  auto take = [&](size_t self, size_t &cur) {
+    for (size_t i = 0; i < threads; i++) {
+      task_deque &victim = deques[(self + i) % threads];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        if (i == 0) {
+          cur = victim.tasks.back();
+          victim.tasks.pop_back();
+        } else {
+          cur = victim.tasks.front();
+          victim.tasks.pop_front();
+        }
+        queued.fetch_sub(1);
+        return true;
+      }
+    }
+    return false;
+  };
+  auto work = [&](size_t self) {
+    size_t cur;
+    while (remaining.load(std::memory_order_acquire) != 0) {
+      if (!take(self, cur)) {
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        sleeping.fetch_add(1);
+        idle.wait(lock, [&] {
+          return queued.load() != 0 || remaining.load() == 0;
+        });
+        sleeping.fetch_sub(1);
+        continue;
+      }
+      task(cur);
+      for (size_t dependent: dependents[cur]) {
+        // The last finished dependency publishes the results of all of them to the thread running the task
+        if (pending[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          {
+            std::lock_guard<std::mutex> lock(deques[self].mutex);
+            deques[self].tasks.push_back(dependent);
+          }
+          queued.fetch_add(1);
+          notify(false);
+        }
+      }
+      if (remaining.fetch_sub(1) == 1) {
+        notify(true);
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < threads; i++) {
+    workers.emplace_back(work, i);
+  }
+  work(0);
+  for (auto &worker: workers) {
+    worker.join();
+  }
+}
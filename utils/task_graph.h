@@ -0,0 +1,30 @@
+//
+// Created by stepavly on 18.10.2026.
+//
+
+#ifndef PARSER_GENERATOR_UTILS_TASK_GRAPH_H_
+#define PARSER_GENERATOR_UTILS_TASK_GRAPH_H_
+
+#include <functional>
+#include <vector>
+
+/**
+ * Directed acyclic graph of tasks run by a work-stealing pool: every task is started after all of its dependencies.
+ * A thread pushes the tasks it made ready to the back of its own deque and takes tasks from there,
+ * when the deque is empty it steals from the front of the deques of other threads.
+ * Threads which find no task wait on a condition variable until a task is queued or all tasks are done.
+ */
+class task_graph {
+ public:
+  explicit task_graph(size_t size);
+
+  void add_dependency(size_t task, size_t dependency);
+  // Tasks must not throw, run is single-threaded when threads < 2
+  void run(const std::function<void(size_t)> &task, size_t threads) const;
+
+ private:
+  std::vector<size_t> dependencies_count;
+  std::vector<std::vector<size_t>> dependents;
+};
+
+#endif //PARSER_GENERATOR_UTILS_TASK_GRAPH_H_
@@ -3,6 +3,7 @@
 //
 
 #include "utils.h"
+#include <stdexcept>
 
 std::string escape(const std::string &s) {
   std::string res;